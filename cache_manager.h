@@ -0,0 +1,187 @@
+// Caché de recursos con presupuesto de memoria y expulsión LRU
+// Guarda especímenes cargados (volúmenes de etiquetas, pirámide, máscaras en bits) y mallas por
+// órgano y nivel de detalle. Las claves llevan el espécimen, la selección y los parámetros de
+// extracción, así que volver a una combinación ya vista no recalcula nada.
+
+#ifndef CACHE_MANAGER_H
+#define CACHE_MANAGER_H
+
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+class CacheRecursos {
+public:
+    explicit CacheRecursos(size_t presupuestoBytes) : presupuesto(presupuestoBytes) {}
+    CacheRecursos(const CacheRecursos&) = delete;
+    CacheRecursos& operator=(const CacheRecursos&) = delete;
+
+    // Espera las cargas pendientes; sus hilos guardan en la caché al terminar.
+    ~CacheRecursos() {
+        std::list<std::future<void>> pendientes;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            pendientes.swap(hilos);
+        }
+    }
+
+    void setPresupuesto(size_t bytes) {
+        std::lock_guard<std::mutex> lock(m);
+        presupuesto = bytes;
+        expulsar(0);
+    }
+
+    // Recurso en caché o nullptr; un acierto lo pasa a ser el más reciente.
+    template <typename T>
+    std::shared_ptr<const T> buscar(const std::string& clave) {
+        std::lock_guard<std::mutex> lock(m);
+        auto it = entradas.find(clave);
+        if (it == entradas.end()) {
+            ++fallos;
+            return nullptr;
+        }
+        ++aciertos;
+        orden.splice(orden.begin(), orden, it->second.pos);
+        return std::static_pointer_cast<const T>(it->second.valor);
+    }
+
+    // Solo consulta: no cuenta como acierto ni cambia el orden LRU.
+    bool contiene(const std::string& clave) const {
+        std::lock_guard<std::mutex> lock(m);
+        return entradas.count(clave) != 0;
+    }
+
+    // Un recurso fijado no se expulsa (sigue contando en el presupuesto); sirve para el que está en
+    // pantalla, que si no quedaría detrás de todo lo que se genera mientras se mira.
+    void fijar(const std::string& clave) {
+        std::lock_guard<std::mutex> lock(m);
+        fijadas.insert(clave);
+    }
+    void soltar(const std::string& clave) {
+        std::lock_guard<std::mutex> lock(m);
+        fijadas.erase(clave);
+        expulsar(0);
+    }
+
+    // Los recursos más grandes que el presupuesto completo no se guardan. Quien tenga un
+    // shared_ptr a un recurso expulsado lo sigue pudiendo usar; solo deja de contar aquí.
+    template <typename T>
+    void guardar(const std::string& clave, std::shared_ptr<const T> valor, size_t bytes) {
+        std::lock_guard<std::mutex> lock(m);
+        auto it = entradas.find(clave);
+        if (it != entradas.end()) {
+            usados -= it->second.bytes;
+            orden.erase(it->second.pos);
+            entradas.erase(it);
+        }
+        if (bytes > presupuesto) return;
+        expulsar(bytes);
+        orden.push_front(clave);
+        entradas[clave] = Entrada{ std::static_pointer_cast<const void>(valor), bytes, orden.begin() };
+        usados += bytes;
+    }
+
+    // Carga en segundo plano: `crear` corre en otro hilo y el resultado se guarda con el tamaño
+    // que indique `medir`. Si la clave ya está en caché o cargándose se reutiliza ese resultado.
+    // En cuanto se guarda, la carga sale de `enCarga`: el futuro que queda ahí retendría el
+    // recurso aunque la caché ya lo hubiera expulsado.
+    template <typename T, typename Crear, typename Medir>
+    std::shared_future<std::shared_ptr<const T>> cargar(const std::string& clave, Crear crear, Medir medir) {
+        typedef std::shared_future<std::shared_ptr<const T>> Futuro;
+        std::lock_guard<std::mutex> lock(m);
+        limpiarHilos();
+        auto it = entradas.find(clave);
+        if (it != entradas.end()) {
+            ++aciertos;
+            orden.splice(orden.begin(), orden, it->second.pos);
+            std::promise<std::shared_ptr<const T>> listo;
+            listo.set_value(std::static_pointer_cast<const T>(it->second.valor));
+            return listo.get_future().share();
+        }
+        auto c = enCarga.find(clave);
+        if (c != enCarga.end()) return *std::static_pointer_cast<Futuro>(c->second);
+
+        ++fallos;
+        // El valor viaja por una promesa y no por el futuro de std::async: así el hilo puede soltar
+        // la entrada de `enCarga` sin destruir el último futuro de su propia tarea.
+        auto promesa = std::make_shared<std::promise<std::shared_ptr<const T>>>();
+        Futuro futuro = promesa->get_future().share();
+        enCarga[clave] = std::make_shared<Futuro>(futuro);
+        hilos.push_back(std::async(std::launch::async, [this, clave, crear, medir, promesa]() mutable {
+            try {
+                std::shared_ptr<const T> valor = crear();
+                if (valor) guardar<T>(clave, valor, medir(*valor));
+                terminarCarga(clave);
+                promesa->set_value(std::move(valor));
+            }
+            catch (...) {
+                terminarCarga(clave);
+                promesa->set_exception(std::current_exception());
+            }
+            promesa.reset();   // la tarea sigue en `hilos` hasta la próxima carga: que no retenga el valor
+        }));
+        return futuro;
+    }
+
+    size_t bytesUsados() const { std::lock_guard<std::mutex> lock(m); return usados; }
+    size_t bytesPresupuesto() const { std::lock_guard<std::mutex> lock(m); return presupuesto; }
+
+    std::string resumen() const {
+        std::lock_guard<std::mutex> lock(m);
+        return std::to_string(usados >> 20) + " de " + std::to_string(presupuesto >> 20) + " MB, "
+             + std::to_string(entradas.size()) + " recursos, " + std::to_string(aciertos) + " aciertos, "
+             + std::to_string(fallos) + " fallos, " + std::to_string(expulsados) + " expulsados";
+    }
+
+private:
+    struct Entrada {
+        std::shared_ptr<const void> valor;
+        size_t bytes = 0;
+        std::list<std::string>::iterator pos;
+    };
+
+    mutable std::mutex m;
+    size_t presupuesto;
+    size_t usados = 0;
+    size_t aciertos = 0, fallos = 0, expulsados = 0;
+    std::list<std::string> orden;   // del más reciente al menos reciente
+    std::unordered_map<std::string, Entrada> entradas;
+    std::unordered_map<std::string, std::shared_ptr<void>> enCarga;   // shared_future<shared_ptr<const T>>
+    std::list<std::future<void>> hilos;                                 // tareas de carga, para esperarlas al final
+    std::unordered_set<std::string> fijadas;
+
+    // Saca los menos recientes no fijados hasta que quepan `nuevos` bytes más.
+    void expulsar(size_t nuevos) {
+        auto it = orden.end();
+        while (it != orden.begin() && usados + nuevos > presupuesto) {
+            --it;
+            if (fijadas.count(*it)) continue;
+            auto entrada = entradas.find(*it);
+            usados -= entrada->second.bytes;
+            entradas.erase(entrada);
+            it = orden.erase(it);
+            ++expulsados;
+        }
+    }
+
+    void terminarCarga(const std::string& clave) {
+        std::lock_guard<std::mutex> lock(m);
+        enCarga.erase(clave);
+    }
+
+    // Las tareas terminadas no retienen nada (devuelven void); solo se descartan sus futuros.
+    void limpiarHilos() {
+        for (auto it = hilos.begin(); it != hilos.end();) {
+            if (it->wait_for(std::chrono::seconds(0)) == std::future_status::ready) it = hilos.erase(it);
+            else ++it;
+        }
+    }
+};
+
+#endif
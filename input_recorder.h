@@ -0,0 +1,153 @@
+// Grabación de la entrada del usuario y reproducción determinista para medir el ciclo de render
+// Formato de texto, una línea por evento: <cuadro> <segundos> <tipo> <datos...>
+//   B boton accion mods x y   |  C x y  |  S dx dy  |  K tecla accion mods
+//   M mascara estado          |  E expresion...      |  F   (fin de la grabación)
+// Al reproducir, los eventos se aplican en el mismo número de cuadro en que se grabaron.
+
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct EventoEntrada {
+    int cuadro = 0;
+    double tiempo = 0.0;
+    char tipo = 0;
+    double x = 0.0, y = 0.0;   // cursor, scroll o posición del botón
+    int a = 0, b = 0, c = 0;   // botón/tecla/máscara, acción/estado, mods
+    std::string texto;         // expresión de máscaras
+};
+
+class GrabadorEntrada {
+public:
+    int cuadro = 0;   // lo actualiza el ciclo de render
+
+    bool abrir(const std::string& ruta) {
+        archivo.open(ruta);
+        if (!archivo) {
+            std::cerr << "Error - no se pudo crear la grabacion " << ruta << std::endl;
+            return false;
+        }
+        archivo << "# ranita-grabacion 1" << std::endl;
+        archivo << std::setprecision(17);
+        inicio = std::chrono::steady_clock::now();
+        return true;
+    }
+    bool activo() const { return archivo.is_open(); }
+
+    void boton(int button, int action, int mods, double x, double y) {
+        if (activo()) cabecera('B') << button << ' ' << action << ' ' << mods << ' ' << x << ' ' << y << '\n';
+    }
+    void cursor(double x, double y) {
+        if (activo()) cabecera('C') << x << ' ' << y << '\n';
+    }
+    void scroll(double dx, double dy) {
+        if (activo()) cabecera('S') << dx << ' ' << dy << '\n';
+    }
+    void tecla(int key, int action, int mods) {
+        if (activo()) cabecera('K') << key << ' ' << action << ' ' << mods << '\n';
+    }
+    void mascara(int indice, bool estado) {
+        if (activo()) cabecera('M') << indice << ' ' << (estado ? 1 : 0) << '\n';
+    }
+    void expresion(const std::string& texto) {
+        if (activo()) cabecera('E') << texto << '\n';
+    }
+    void cerrar() {
+        if (!activo()) return;
+        cabecera('F') << '\n';
+        archivo.close();
+    }
+
+private:
+    std::ofstream archivo;
+    std::chrono::steady_clock::time_point inicio;
+
+    std::ostream& cabecera(char tipo) {
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+        archivo << cuadro << ' ' << t << ' ' << tipo << ' ';
+        return archivo;
+    }
+};
+
+// Lee una grabación; `cuadros` recibe el número de cuadros de la sesión (línea F).
+inline bool cargarGrabacion(const std::string& ruta, std::vector<EventoEntrada>& eventos, int& cuadros) {
+    std::ifstream archivo(ruta);
+    if (!archivo) {
+        std::cerr << "Error - no se pudo abrir la grabacion " << ruta << std::endl;
+        return false;
+    }
+    eventos.clear();
+    cuadros = 0;
+    std::string linea;
+    int numLinea = 0;
+    while (std::getline(archivo, linea)) {
+        ++numLinea;
+        if (linea.empty() || linea[0] == '#') continue;
+        std::istringstream in(linea);
+        EventoEntrada ev;
+        in >> ev.cuadro >> ev.tiempo >> ev.tipo;
+        switch (ev.tipo) {
+        case 'B': in >> ev.a >> ev.b >> ev.c >> ev.x >> ev.y; break;
+        case 'C': in >> ev.x >> ev.y; break;
+        case 'S': in >> ev.x >> ev.y; break;
+        case 'K': in >> ev.a >> ev.b >> ev.c; break;
+        case 'M': in >> ev.a >> ev.b; break;
+        case 'E': in >> std::ws; std::getline(in, ev.texto); break;
+        case 'F': cuadros = ev.cuadro; continue;
+        default:
+            std::cerr << "Error - evento desconocido en la linea " << numLinea << " de " << ruta << std::endl;
+            return false;
+        }
+        if (in.fail()) {
+            std::cerr << "Error - linea " << numLinea << " mal formada en " << ruta << std::endl;
+            return false;
+        }
+        eventos.push_back(ev);
+    }
+    // Grabación cortada sin línea F: se reproduce hasta el último evento
+    if (cuadros == 0 && !eventos.empty()) cuadros = eventos.back().cuadro + 1;
+    return true;
+}
+
+// Tiempos de CPU por cuadro durante la reproducción.
+struct TiemposCuadro {
+    double actualizar = 0.0;   // eventos, vista previa y subida de mallas
+    double dibujar = 0.0;      // preparación y envío de los draw calls (incluye raycasting en CPU)
+    double presentar = 0.0;    // glfwSwapBuffers
+    double reconstruir = 0.0;  // espera al espécimen y a las mallas de fondo (fuera del total: en la sesión no bloquea)
+    double total() const { return actualizar + dibujar + presentar; }
+};
+
+inline void escribirTiempos(const std::string& ruta, const std::vector<TiemposCuadro>& tiempos) {
+    std::ofstream csv(ruta);
+    csv << "cuadro,actualizar_ms,dibujar_ms,presentar_ms,total_ms,reconstruir_ms\n";
+    for (size_t i = 0; i < tiempos.size(); ++i)
+        csv << i << ',' << tiempos[i].actualizar << ',' << tiempos[i].dibujar << ','
+            << tiempos[i].presentar << ',' << tiempos[i].total() << ',' << tiempos[i].reconstruir << '\n';
+}
+
+inline void resumirTiempos(const std::vector<TiemposCuadro>& tiempos) {
+    if (tiempos.empty()) return;
+    std::vector<double> totales;
+    double suma = 0.0, reconstruir = 0.0;
+    for (const auto& t : tiempos) {
+        totales.push_back(t.total());
+        suma += t.total();
+        reconstruir += t.reconstruir;
+    }
+    std::sort(totales.begin(), totales.end());
+    auto percentil = [&](double p) { return totales[std::min(totales.size() - 1, (size_t)(p * totales.size()))]; };
+    std::cout << "Reproduccion: " << tiempos.size() << " cuadros, media " << suma / tiempos.size()
+              << " ms, p50 " << percentil(0.5) << " ms, p95 " << percentil(0.95)
+              << " ms, max " << totales.back() << " ms; mallas de fondo " << reconstruir << " ms" << std::endl;
+}
+
+#endif
@@ -0,0 +1,28 @@
+// Volumen de etiquetas: un byte por vóxel con la máscara a la que pertenece
+
+#ifndef LABEL_VOLUME_H
+#define LABEL_VOLUME_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Etiqueta 0 = vacío, etiqueta m+1 = máscara m (índice en `mascaras`).
+// Almacenamiento plano en orden x -> y -> z (x es el índice que varía más rápido).
+struct VolumenEtiquetas {
+    int ancho = 0, alto = 0, profundo = 0;
+    std::vector<uint8_t> etiquetas;
+
+    void redimensionar(int w, int h, int d) {
+        ancho = w; alto = h; profundo = d;
+        etiquetas.assign((size_t)w * h * d, 0);
+    }
+    size_t indice(int x, int y, int z) const {
+        return ((size_t)z * alto + y) * ancho + x;
+    }
+    uint8_t at(int x, int y, int z) const { return etiquetas[indice(x, y, z)]; }
+    uint8_t& at(int x, int y, int z) { return etiquetas[indice(x, y, z)]; }
+    bool vacio() const { return etiquetas.empty(); }
+};
+
+#endif
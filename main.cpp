@@ -4,10 +4,27 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "marching_cubes_tables.h"
+#include "label_volume.h"
+#include "volume_raycaster.h"
+#include "mesh_optimizer.h"
+#include "mask_algebra.h"
+#include "input_recorder.h"
+#include "cache_manager.h"
 
 using namespace std;
 
@@ -52,14 +69,46 @@ glm::vec3 mascara_colors[] = {
     {1.0, 0.5, 0.3},      // stomachMasks: Estómago - naranja salmón
 };
 
+// Opacidad por unidad de longitud (en vóxeles) para el raycasting de volumen.
+// Los órganos grandes y densos van más transparentes para dejar ver lo que envuelven.
+float mascara_opacidad[] = {
+    0.6f,   // bloodMasks
+    0.4f,   // brainMasks
+    0.5f,   // duodenumMasks
+    0.8f,   // eyeMasks
+    0.8f,   // eyeRetinaMasks
+    0.8f,   // eyeWhiteMasks
+    0.6f,   // heartMasks
+    0.5f,   // ileumMasks
+    0.5f,   // kidneyMasks
+    0.5f,   // lIntestineMasks
+    0.5f,   // liverMasks
+    0.2f,   // lungMasks
+    0.03f,  // muscleMasks
+    0.8f,   // nerveMasks
+    0.15f,  // skeletonMasks
+    0.5f,   // spleenMasks
+    0.5f,   // stomachMasks
+};
+
 vector<bool> mascara_activa(mascaras.size(), true);
 
+// Carpetas de especímenes (--dataset, se puede repetir); la tecla n pasa al siguiente
+vector<string> rutas_especimenes;
+size_t especimen_actual = 0;
+
 void printMascaraStatus() {
     cout << "\n======= Estado de las máscaras =======" << endl;
     for (size_t i = 0; i < mascara_activa.size(); ++i)
         cout << "[" << (char)((i<9)?('1'+i):('a'+i-9)) << "] "
              << mascaras[i] << ": " << (mascara_activa[i] ? "ON" : "OFF") << endl;
     cout << "[r] Recargar malla con las máscaras actuales" << endl;
+    cout << "    (al cambiar máscaras se muestran puntos y luego la malla de 1/8 a resolución completa)" << endl;
+    cout << "[v] Alternar malla / raycasting de volumen (CPU)" << endl;
+    cout << "[n] Siguiente especimen (" << especimen_actual + 1 << "/" << rutas_especimenes.size() << ": "
+         << rutas_especimenes[especimen_actual] << ")" << endl;
+    cout << "Expresiones (escribir en esta consola y Enter; linea vacia para salir):" << endl;
+    cout << "    muscle - skeleton | blood & liver | dilate(nerve, 2) | erode(...)" << endl;
     cout << "======================================" << endl << endl;
 }
 
@@ -69,20 +118,39 @@ double lastX = 0.0, lastY = 0.0;
 float yaw = 0.0f, pitch = 0.0f;
 float translateX = 0.0f, translateY = 0.0f;
 float zoom = 1.0f;
+GrabadorEntrada grabador;   // --record: guarda la entrada para reproducirla con --replay
+
+// Misma cámara para la malla, la vista previa y el raycasting de volumen
+void calcularCamara(int ancho, int alto, glm::mat4& model, glm::mat4& view, glm::mat4& proj, glm::vec3& camaraPos) {
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(translateX, translateY, 0.0f));
+    model = glm::rotate(model, glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(pitch), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::scale(model, glm::vec3(zoom));
+    model = glm::translate(model, glm::vec3(-128.0f, -128.0f, -68.0f));
+    glm::vec3 modeloCentro(128.0f, 128.0f, 68.0f);
+    camaraPos = modeloCentro + glm::vec3(0, 0, 500);
+    glm::vec3 camaraFrente = modeloCentro;
+    glm::vec3 camaraArriba = glm::vec3(0, 1, 0);
+    view = glm::lookAt(camaraPos, camaraFrente, camaraArriba);
+    proj = glm::perspective(glm::radians(60.0f), ancho / float(alto), 0.1f, 2000.0f);
+}
 
 // ================== CALLBACKS DE INTERACTIVIDAD ==================
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+// Los callbacks graban el evento y llaman a aplicar*, que es lo que usa también la reproducción.
+void aplicarBotonRaton(int button, int action, double x, double y) {
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
         if (action == GLFW_PRESS) {
             mousePressed = true;
-            glfwGetCursorPos(window, &lastX, &lastY);
+            lastX = x;
+            lastY = y;
         }
         else if (action == GLFW_RELEASE) {
             mousePressed = false;
         }
     }
 }
-void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
+void aplicarCursor(double xpos, double ypos) {
     if (mousePressed) {
         float sensitivity = 0.2f;
         float dx = xpos - lastX;
@@ -93,11 +161,26 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
         lastY = ypos;
     }
 }
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+void aplicarScroll(double xoffset, double yoffset) {
     zoom += yoffset * 0.1f;
     zoom = std::max(0.1f, zoom);
 }
 
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    grabador.boton(button, action, mods, x, y);
+    aplicarBotonRaton(button, action, x, y);
+}
+void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
+    if (mousePressed) grabador.cursor(xpos, ypos);   // sin arrastre el cursor no cambia nada
+    aplicarCursor(xpos, ypos);
+}
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+    grabador.scroll(xoffset, yoffset);
+    aplicarScroll(xoffset, yoffset);
+}
+
 // ================== ESTRUCTURAS ======================
 struct Punto3D {
     float x, y, z;
@@ -108,6 +191,11 @@ struct Vertex {
     glm::vec3 normal = glm::vec3(0.0f);
     glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
 };
+// Punto compacto para la vista previa (8 bytes): el color se toma de la máscara en el shader
+struct PuntoGPU {
+    uint16_t x, y, z;
+    uint16_t mascara;
+};
 
 // ================== SHADERS ======================
 const char* vertexShaderSource = R"(
@@ -165,11 +253,71 @@ void main() {
 }
 )";
 
-GLuint crearShaderProgram() {
+// Vista previa: cada vóxel activo se dibuja como un punto del tamaño de un vóxel en pantalla
+const char* pointVertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in uint aMascara;
+
+out vec3 Color;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 mascaraColores[32];
+uniform float tamPunto;
+
+void main() {
+    Color = mascaraColores[aMascara];
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_PointSize = max(1.0, tamPunto / gl_Position.w);
+}
+)";
+const char* pointFragmentShaderSource = R"(
+#version 330 core
+in vec3 Color;
+
+out vec4 FragColor;
+
+void main() {
+    // Sombreado esférico aproximado para que el splat no se vea plano
+    vec2 d = gl_PointCoord * 2.0 - 1.0;
+    float r2 = dot(d, d);
+    if (r2 > 1.0) discard;
+    FragColor = vec4(Color * (0.45 + 0.55 * sqrt(1.0 - r2)), 1.0);
+}
+)";
+
+// Imagen del raycasting de volumen: triángulo que cubre toda la pantalla
+const char* quadVertexShaderSource = R"(
+#version 330 core
+out vec2 TexCoord;
+
+void main() {
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoord = p;
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+const char* quadFragmentShaderSource = R"(
+#version 330 core
+in vec2 TexCoord;
+
+out vec4 FragColor;
+
+uniform sampler2D imagen;
+
+void main() {
+    FragColor = vec4(texture(imagen, TexCoord).rgb, 1.0);
+}
+)";
+
+GLuint crearShaderProgram(const char* vsSource = vertexShaderSource,
+                          const char* fsSource = fragmentShaderSource) {
     GLint success;
     char infoLog[512];
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+    glShaderSource(vertexShader, 1, &vsSource, nullptr);
     glCompileShader(vertexShader);
     glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
     if (!success) {
@@ -177,7 +325,7 @@ GLuint crearShaderProgram() {
         cerr << "Error compilando vertex shader:\n" << infoLog << endl;
     }
     GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+    glShaderSource(fragmentShader, 1, &fsSource, nullptr);
     glCompileShader(fragmentShader);
     glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
     if (!success) {
@@ -216,7 +364,8 @@ void MarchingCubes(const vector<vector<vector<uint8_t>>>& volumen,
                    const vector<vector<vector<glm::vec3>>>& volumen_color,
                    vector<Vertex>& vertices,
                    vector<unsigned int>& indices,
-                   float isoLevel = 0.9f)
+                   float isoLevel = 0.9f,
+                   const atomic<bool>* cancelar = nullptr)   // se consulta una vez por corte z
 {
     int width = volumen[0][0].size();
     int height = volumen[0].size();
@@ -224,6 +373,7 @@ void MarchingCubes(const vector<vector<vector<uint8_t>>>& volumen,
     glm::vec3 vertexList[12];
     glm::vec3 colorList[12];
     for (int z = 0; z < depth - 1; ++z) {
+        if (cancelar && *cancelar) return;
         for (int y = 0; y < height - 1; ++y) {
             for (int x = 0; x < width - 1; ++x) {
                 float cubeVal[8];
@@ -326,24 +476,730 @@ void calcularNormales(std::vector<Vertex>& vertices, const std::vector<unsigned
 }
 
 // ================== MENÚ Y RECARGA EN TIEMPO REAL ===================
-vector< vector<Punto3D> > puntos_por_mascara;
+const int NIVELES_PIRAMIDE = 3;
+
+// Todo lo que se carga de un espécimen. No cambia tras la carga, así que los hilos de las mallas
+// y la caché lo comparten sin copiarlo.
+struct Especimen {
+    string ruta;
+    vector< vector<Punto3D> > puntos_por_mascara;
+    VolumenEtiquetas etiquetas;
+    vector<VolumenBits> bits_por_mascara;
+    // Pirámide por órgano: piramide_bits[m][k] = máscara m a 1/2^(k+1) por eje, reducida con OR
+    // para que ningún órgano desaparezca en los niveles gruesos aunque se solape con otro.
+    vector< vector<VolumenBits> > piramide_bits;
+
+    size_t bytes() const {
+        size_t total = etiquetas.etiquetas.size();
+        for (const auto& puntos : puntos_por_mascara) total += puntos.capacity() * sizeof(Punto3D);
+        for (const auto& bits : bits_por_mascara) total += bits.bits.size() * sizeof(uint64_t);
+        for (const auto& niveles : piramide_bits)
+            for (const auto& bits : niveles) total += bits.bits.size() * sizeof(uint64_t);
+        return total;
+    }
+};
+shared_ptr<const Especimen> especimen;      // el que se está mostrando (nullptr hasta la primera carga)
+CacheRecursos cache_recursos((size_t)2048 << 20);   // --cache-mb
+
+bool cambiar_especimen = true; // hay que cargar (o sacar de la caché) rutas_especimenes[especimen_actual]
+bool recargar_malla = true;   // se pidió una malla nueva (tecla r o carga inicial)
+bool preview_sucio = true;    // la selección de máscaras cambió y hay que volver a subir los puntos
+bool vista_volumen = false;   // raycasting de volumen en CPU en lugar de la malla
+
+// Selección derivada de una expresión de máscaras; mientras está activa sustituye a mascara_activa
+struct SeleccionCompuesta {
+    string expresion;
+    shared_ptr<const VolumenBits> volumen;
+    int color = 0;   // índice en mascara_colors
+};
+SeleccionCompuesta compuesta;
+
+// Se graba el estado resultante de la máscara, no la tecla, para que la reproducción no dependa
+// del estado inicial ni de la distribución del teclado.
+void fijarMascara(size_t i, bool estado) {
+    grabador.mascara((int)i, estado);
+    mascara_activa[i] = estado;
+    compuesta = SeleccionCompuesta();   // volver a la selección por máscaras
+    preview_sucio = true;
+    recargar_malla = true;              // la versión gruesa llega en milisegundos
+    printMascaraStatus();
+}
+
+void aplicarTecla(int key) {
+    if (key == GLFW_KEY_R) {
+        recargar_malla = true;
+    }
+    if (key == GLFW_KEY_V) {
+        vista_volumen = !vista_volumen;
+        cout << "Vista: " << (vista_volumen ? "raycasting de volumen" : "malla") << endl;
+    }
+    if (key == GLFW_KEY_N) {
+        especimen_actual = (especimen_actual + 1) % rutas_especimenes.size();
+        cambiar_especimen = true;
+        cout << "Especimen: " << rutas_especimenes[especimen_actual] << endl;
+    }
+}
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (action == GLFW_PRESS) {
         for (size_t i = 0; i < mascara_activa.size(); ++i) {
             int code = (i < 9) ? GLFW_KEY_1 + i : GLFW_KEY_A + (i-9);
             if (key == code) {
-                mascara_activa[i] = !mascara_activa[i];
-                printMascaraStatus();
+                fijarMascara(i, !mascara_activa[i]);
+                return;
+            }
+        }
+        grabador.tecla(key, action, mods);
+        aplicarTecla(key);
+    }
+}
+
+// ================== CARGA DE MÁSCARAS ===================
+void cargarMascaras(const string& ruta_base, vector< vector<Punto3D> >& puntos_por_mascara) {
+    puntos_por_mascara.assign(mascaras.size(), vector<Punto3D>());
+    string extension = "_frame_";
+    string extension2 = ".png";
+
+    for (size_t mi = 0; mi < mascaras.size(); ++mi) {
+        string mascara = mascaras[mi];
+        cout << "Procesando mascara: " << mascara << endl;
+        for (int i = 1; i <= 136; ++i) {
+            string ruta_img =  ruta_base + "/" + mascara + extension + to_string(i) + extension2;
+            cv::Mat img = cv::imread(ruta_img, cv::IMREAD_GRAYSCALE);
+            if (img.empty()) continue;
+            // Si quieres filtro especial para alguna máscara, ponlo aquí
+            for (int y = 0; y < img.rows; ++y) {
+                for (int x = 0; x < img.cols; ++x) {
+                    if (img.at<uchar>(y, x) > 127) {
+                        puntos_por_mascara[mi].push_back({ static_cast<float>(x), static_cast<float>(y), static_cast<float>(i), mascara_colors[mi] });
+                    }
+                }
             }
         }
-        if (key == GLFW_KEY_R) {
-            glfwSetWindowShouldClose(window, 2); // señal especial para recargar malla
+    }
+}
+
+// Volumen de etiquetas con todas las máscaras (si se solapan, gana la de mayor índice).
+void construirVolumenEtiquetas(const vector< vector<Punto3D> >& puntos_por_mascara, VolumenEtiquetas& vol) {
+    int maxX = 0, maxY = 0, maxZ = 0;
+    for (const auto& puntos : puntos_por_mascara)
+        for (const auto& p : puntos) {
+            maxX = std::max(maxX, (int)p.x);
+            maxY = std::max(maxY, (int)p.y);
+            maxZ = std::max(maxZ, (int)p.z);
         }
+    vol.redimensionar(maxX + 1, maxY + 1, maxZ + 1);
+    for (size_t mi = 0; mi < puntos_por_mascara.size(); ++mi)
+        for (const auto& p : puntos_por_mascara[mi])
+            vol.at((int)p.x, (int)p.y, (int)p.z) = (uint8_t)(mi + 1);
+}
+
+// Una máscara empaquetada en bits por órgano, todas con las dimensiones del volumen de etiquetas.
+void construirMascarasBits(Especimen& esp) {
+    const VolumenEtiquetas& vol = esp.etiquetas;
+    esp.bits_por_mascara.assign(mascaras.size(), VolumenBits());
+    for (size_t mi = 0; mi < esp.puntos_por_mascara.size(); ++mi) {
+        esp.bits_por_mascara[mi].redimensionar(vol.ancho, vol.alto, vol.profundo);
+        for (const auto& p : esp.puntos_por_mascara[mi])
+            esp.bits_por_mascara[mi].set((int)p.x, (int)p.y, (int)p.z);
     }
 }
 
-int main() {
+// Pirámide por órgano para la reconstrucción progresiva.
+void construirPiramide(Especimen& esp) {
+    esp.piramide_bits.assign(esp.bits_por_mascara.size(), vector<VolumenBits>());
+    for (size_t mi = 0; mi < esp.bits_por_mascara.size(); ++mi) {
+        vector<VolumenBits>& niveles = esp.piramide_bits[mi];
+        niveles.reserve(NIVELES_PIRAMIDE);
+        const VolumenBits* fino = &esp.bits_por_mascara[mi];
+        for (int k = 0; k < NIVELES_PIRAMIDE; ++k) {
+            niveles.push_back(reducirBits(*fino));
+            fino = &niveles.back();
+        }
+    }
+}
+
+// Carga completa de un espécimen; se llama desde el hilo de carga de la caché.
+shared_ptr<const Especimen> cargarEspecimen(const string& ruta) {
+    auto t0 = chrono::steady_clock::now();
+    auto esp = make_shared<Especimen>();
+    esp->ruta = ruta;
+    cargarMascaras(ruta, esp->puntos_por_mascara);
+    construirVolumenEtiquetas(esp->puntos_por_mascara, esp->etiquetas);
+    construirMascarasBits(*esp);
+    construirPiramide(*esp);
+    auto t1 = chrono::steady_clock::now();
+    cout << "Especimen " << ruta << " cargado en " << chrono::duration_cast<chrono::milliseconds>(t1 - t0).count()
+         << " ms (" << (esp->bytes() >> 20) << " MB)" << endl;
+    return esp;
+}
+
+string claveEspecimen(const string& ruta) {
+    return "especimen|" + ruta;
+}
+
+// El espécimen sale de la caché o se carga en segundo plano.
+shared_future<shared_ptr<const Especimen>> pedirEspecimen(const string& ruta) {
+    return cache_recursos.cargar<Especimen>(claveEspecimen(ruta),
+                                            [ruta]() { return cargarEspecimen(ruta); },
+                                            [](const Especimen& esp) { return esp.bytes(); });
+}
+
+// ================== EXPRESIONES DESDE LA CONSOLA ===================
+// Un hilo lee líneas de stdin para no bloquear el ciclo de render; el ciclo las recoge cada cuadro.
+mutex mutex_consola;
+vector<string> lineas_consola;
+
+void leerConsola() {
+    string linea;
+    while (getline(cin, linea)) {
+        lock_guard<mutex> lock(mutex_consola);
+        lineas_consola.push_back(linea);
+    }
+}
+
+void procesarExpresion(string linea) {
+    linea.erase(0, linea.find_first_not_of(" \t\r"));
+    linea.erase(linea.find_last_not_of(" \t\r") + 1);
+    grabador.expresion(linea.empty() ? "off" : linea);
+    if (linea.empty() || linea == "off") {
+        if (compuesta.volumen) {
+            compuesta = SeleccionCompuesta();
+            preview_sucio = true;
+            recargar_malla = true;
+            cout << "Expresion desactivada, se vuelve a las mascaras activas" << endl;
+        }
+        return;
+    }
+    if (!especimen) {
+        cerr << "Error en la expresion: el especimen aun se esta cargando" << endl;
+        return;
+    }
+    auto t0 = chrono::steady_clock::now();
+    ExpresionMascaras evaluador(mascaras, especimen->bits_por_mascara);
+    shared_ptr<VolumenBits> resultado = make_shared<VolumenBits>();
+    if (!evaluador.evaluar(linea, *resultado)) {
+        cerr << "Error en la expresion: " << evaluador.error << endl;
+        return;
+    }
+    auto t1 = chrono::steady_clock::now();
+    cout << "Expresion '" << linea << "': " << resultado->contar() << " voxeles en "
+         << chrono::duration<double, milli>(t1 - t0).count() << " ms" << endl;
+    compuesta.expresion = linea;
+    compuesta.volumen = resultado;
+    compuesta.color = evaluador.primeraMascara;
+    preview_sucio = true;
+    recargar_malla = true;
+}
+
+// Reproduce un evento grabado con las mismas funciones que usan los callbacks y la consola.
+void aplicarEvento(const EventoEntrada& ev) {
+    switch (ev.tipo) {
+    case 'B': aplicarBotonRaton(ev.a, ev.b, ev.x, ev.y); break;
+    case 'C': aplicarCursor(ev.x, ev.y); break;
+    case 'S': aplicarScroll(ev.x, ev.y); break;
+    case 'K': aplicarTecla(ev.a); break;
+    case 'M':
+        if (ev.a >= 0 && ev.a < (int)mascara_activa.size()) fijarMascara(ev.a, ev.b != 0);
+        break;
+    case 'E': procesarExpresion(ev.texto); break;
+    }
+}
+
+// Modo sin ventana: mide el raycasting de volumen girando la cámara y guarda el último cuadro.
+int benchmarkRaycasting(const string& ruta, int cuadros, int ancho, int alto) {
+    shared_ptr<const Especimen> esp = cargarEspecimen(ruta);
+    RaycasterVolumen raycaster;
+    raycaster.setVolumen(&esp->etiquetas);
+    raycaster.setTransferencia(mascara_colors, mascara_opacidad, mascara_activa);
+
+    ImagenRGBA imagen;
+    imagen.ancho = ancho;
+    imagen.alto = alto;
+    double totalMs = 0.0;
+    for (int i = 0; i < cuadros; ++i) {
+        yaw = 360.0f * i / cuadros;
+        glm::mat4 model, view, proj;
+        glm::vec3 camaraPos;
+        calcularCamara(ancho, alto, model, view, proj, camaraPos);
+        auto t0 = chrono::steady_clock::now();
+        raycaster.render(proj * view * model, imagen, glm::vec3(0.05f, 0.05f, 0.1f));
+        auto t1 = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(t1 - t0).count();
+        totalMs += ms;
+        cout << "Cuadro " << i << ": " << ms << " ms" << endl;
+    }
+    cout << "Raycasting " << ancho << "x" << alto << ": " << totalMs / std::max(1, cuadros)
+         << " ms/cuadro de media (" << thread::hardware_concurrency() << " hilos)" << endl;
+    if (imagen.pixeles.empty()) return 0;   // sin cuadros no hay imagen que guardar
+
+    // OpenCV guarda en BGR y con la fila 0 arriba
+    cv::Mat salida(alto, ancho, CV_8UC3);
+    for (int y = 0; y < alto; ++y)
+        for (int x = 0; x < ancho; ++x) {
+            const uint8_t* p = &imagen.pixeles[((size_t)(alto - 1 - y) * ancho + x) * 4];
+            cv::Vec3b& q = salida.at<cv::Vec3b>(y, x);
+            q[0] = p[2]; q[1] = p[1]; q[2] = p[0];
+        }
+    cv::imwrite("raycast_bench.png", salida);
+    return 0;
+}
+
+// Modo sin ventana: compara el raycasting con salto de espacio vacío contra el DDA vóxel a vóxel
+// sin bloques (renderReferencia) sobre un volumen sintético, girando la cámara. Con el mismo
+// recorrido los dos solo pueden diferir por redondeo; se toleran unos pocos canales sueltos.
+const int RAYCAST_TOLERANCIA = 2;            // diferencia por canal (de 255) que cuenta como igual
+const double RAYCAST_MAX_DISTINTOS = 1e-4;   // fracción de canales RGB que puede superarla
+int verificarRaycasting(int cuadros, int ancho, int alto) {
+    VolumenEtiquetas vol;
+    vol.redimensionar(256, 256, 136);
+    struct Esfera { glm::vec3 c; float r; uint8_t etiqueta; };
+    const Esfera esferas[] = {
+        { glm::vec3(100.0f, 120.0f, 60.0f), 37.3f, 15 },   // esqueleto
+        { glm::vec3(150.0f, 130.0f, 70.0f), 45.7f, 13 },   // músculo, se solapa con el esqueleto
+        { glm::vec3(128.0f, 60.0f, 90.0f), 19.1f, 1 },     // sangre
+        { glm::vec3(190.0f, 200.0f, 40.0f), 11.6f, 7 },    // corazón, aislado entre bloques vacíos
+    };
+    for (int z = 0; z < vol.profundo; ++z)
+        for (int y = 0; y < vol.alto; ++y)
+            for (int x = 0; x < vol.ancho; ++x)
+                for (const Esfera& s : esferas) {
+                    glm::vec3 d = glm::vec3(x, y, z) - s.c;
+                    if (glm::dot(d, d) <= s.r * s.r) vol.at(x, y, z) = s.etiqueta;
+                }
+    RaycasterVolumen raycaster;
+    raycaster.setVolumen(&vol);
+    raycaster.setTransferencia(mascara_colors, mascara_opacidad, vector<bool>(mascaras.size(), true));
+
+    ImagenRGBA imagen, referencia;
+    imagen.ancho = referencia.ancho = ancho;
+    imagen.alto = referencia.alto = alto;
+    const glm::vec3 fondo(0.05f, 0.05f, 0.1f);
+    size_t canales = 0, distintos = 0;
+    int maxRGB = 0, maxAlfa = 0;
+    pitch = 20.0f;
+    for (int i = 0; i < cuadros; ++i) {
+        yaw = 360.0f * i / cuadros;
+        glm::mat4 model, view, proj;
+        glm::vec3 camaraPos;
+        calcularCamara(ancho, alto, model, view, proj, camaraPos);
+        raycaster.render(proj * view * model, imagen, fondo);
+        raycaster.renderReferencia(proj * view * model, referencia, fondo);
+        for (size_t p = 0; p < imagen.pixeles.size(); p += 4) {
+            for (int c = 0; c < 3; ++c) {
+                int dif = abs((int)imagen.pixeles[p + c] - (int)referencia.pixeles[p + c]);
+                maxRGB = std::max(maxRGB, dif);
+                distintos += dif > RAYCAST_TOLERANCIA;
+            }
+            maxAlfa = std::max(maxAlfa, abs((int)imagen.pixeles[p + 3] - (int)referencia.pixeles[p + 3]));
+            canales += 3;
+        }
+    }
+    bool ok = maxAlfa <= RAYCAST_TOLERANCIA && distintos <= canales * RAYCAST_MAX_DISTINTOS;
+    cout << "Raycasting vs referencia sin bloques, " << cuadros << " cuadros de " << ancho << "x" << alto
+         << ": alfa max " << maxAlfa << ", RGB max " << maxRGB << ", " << distintos << " de " << canales
+         << " canales con diferencia > " << RAYCAST_TOLERANCIA << endl;
+    cout << (ok ? "OK" : "FALLO") << endl;
+    return ok ? 0 : 1;
+}
+
+// ================== VISTA PREVIA Y GENERACIÓN DE MALLA ===================
+// Vóxeles de las máscaras activas en el formato compacto de la vista previa.
+vector<PuntoGPU> construirPuntosPreview(const Especimen& esp, const vector<bool>& activas) {
+    size_t total = 0;
+    for (size_t mi = 0; mi < esp.puntos_por_mascara.size(); ++mi)
+        if (activas[mi]) total += esp.puntos_por_mascara[mi].size();
+    vector<PuntoGPU> puntos;
+    puntos.reserve(total);
+    for (size_t mi = 0; mi < esp.puntos_por_mascara.size(); ++mi) {
+        if (!activas[mi]) continue;
+        for (const auto& p : esp.puntos_por_mascara[mi])
+            puntos.push_back({ (uint16_t)p.x, (uint16_t)p.y, (uint16_t)p.z, (uint16_t)mi });
+    }
+    return puntos;
+}
+vector<PuntoGPU> construirPuntosPreview(const VolumenBits& bits, int color) {
+    vector<PuntoGPU> puntos;
+    puntos.reserve(bits.contar());
+    for (int z = 0; z < bits.profundo; ++z)
+        for (int y = 0; y < bits.alto; ++y) {
+            const uint64_t* fila = bits.fila(y, z);
+            for (int i = 0; i < bits.palabrasFila; ++i) {
+                int b = 0;
+                for (uint64_t w = fila[i]; w; w >>= 1, ++b)
+                    if (w & 1)
+                        puntos.push_back({ (uint16_t)(i * 64 + b), (uint16_t)y, (uint16_t)z, (uint16_t)color });
+            }
+        }
+    return puntos;
+}
+
+struct MallaCPU {
+    string ruta;                   // espécimen, selección y nivel con los que se generó
+    vector<bool> activas;
+    string expresion;
+    int nivel = 0;                 // 0 = resolución completa, k = 1/2^k por eje
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+};
+
+// Volumen binario de un órgano recortado a su caja envolvente, con un vóxel vacío de margen para
+// que la superficie quede cerrada. `origen` recibe la esquina del recorte en coordenadas del nivel.
+// Sale de la máscara en bits del órgano (nivel 0) o de su pirámide, así los solapes con otros
+// órganos se conservan en todos los niveles. Devuelve false si el órgano está vacío en ese nivel.
+bool volumenDeOrgano(const Especimen& esp, size_t mi, int nivel, glm::vec3& origen,
+                     vector<vector<vector<uint8_t>>>& volumen,
+                     vector<vector<vector<glm::vec3>>>& volumen_color) {
+    const VolumenBits& bits = (nivel == 0) ? esp.bits_por_mascara[mi] : esp.piramide_bits[mi][nivel - 1];
+
+    // Caja envolvente palabra a palabra: las palabras vacías (64 vóxeles) se saltan enteras
+    int mn[3] = { bits.ancho, bits.alto, bits.profundo };
+    int mx[3] = { -1, -1, -1 };
+    for (int z = 0; z < bits.profundo; ++z)
+        for (int y = 0; y < bits.alto; ++y) {
+            const uint64_t* fila = bits.fila(y, z);
+            for (int i = 0; i < bits.palabrasFila; ++i) {
+                uint64_t palabra = fila[i];
+                if (!palabra) continue;
+                int primero = 0, ultimo = 63;
+                while (!((palabra >> primero) & 1)) ++primero;
+                while (!((palabra >> ultimo) & 1)) --ultimo;
+                mn[0] = std::min(mn[0], i * 64 + primero);
+                mx[0] = std::max(mx[0], i * 64 + ultimo);
+                mn[1] = std::min(mn[1], y);
+                mx[1] = std::max(mx[1], y);
+                mn[2] = std::min(mn[2], z);
+                mx[2] = std::max(mx[2], z);
+            }
+        }
+    if (mx[0] < 0) return false;
+
+    for (int a = 0; a < 3; ++a) --mn[a];
+    origen = glm::vec3((float)mn[0], (float)mn[1], (float)mn[2]);
+    int w = mx[0] - mn[0] + 2, h = mx[1] - mn[1] + 2, d = mx[2] - mn[2] + 2;
+    volumen.assign(d, vector<vector<uint8_t>>(h, vector<uint8_t>(w, 0)));
+    volumen_color.assign(d, vector<vector<glm::vec3>>(h, vector<glm::vec3>(w, mascara_colors[mi])));
+    for (int z = mn[2] + 1; z <= mx[2]; ++z)
+        for (int y = mn[1] + 1; y <= mx[1]; ++y) {
+            const uint64_t* fila = bits.fila(y, z);
+            uint8_t* destino = volumen[z - mn[2]][y - mn[1]].data();
+            for (int i = (mn[0] + 1) >> 6; i <= (mx[0] >> 6); ++i) {
+                int b = 0;
+                for (uint64_t palabra = fila[i]; palabra; palabra >>= 1, ++b)
+                    if (palabra & 1) destino[i * 64 + b - mn[0]] = 1;
+            }
+        }
+    return true;
+}
+
+// Volumen binario y de color de una expresión de máscaras (un solo color para todo el resultado).
+void volumenDesdeBits(const VolumenBits& bits, glm::vec3 color,
+                      vector<vector<vector<uint8_t>>>& volumen,
+                      vector<vector<vector<glm::vec3>>>& volumen_color) {
+    volumen.assign(bits.profundo, vector<vector<uint8_t>>(bits.alto, vector<uint8_t>(bits.ancho, 0)));
+    volumen_color.assign(bits.profundo, vector<vector<glm::vec3>>(bits.alto, vector<glm::vec3>(bits.ancho, color)));
+    for (int z = 0; z < bits.profundo; ++z)
+        for (int y = 0; y < bits.alto; ++y) {
+            const uint64_t* fila = bits.fila(y, z);
+            uint8_t* destino = volumen[z][y].data();
+            for (int x = 0; x < bits.ancho; ++x)
+                destino[x] = (uint8_t)((fila[x >> 6] >> (x & 63)) & 1);
+        }
+}
+
+const float ISO_MALLA = 0.9f;   // umbral de Marching Cubes; forma parte de la clave de la caché
+
+// Marching Cubes + optimización de un volumen ya armado cuya esquina está en `origen`. Los niveles
+// gruesos se llevan a coordenadas de resolución completa: el vóxel grueso X cubre los finos
+// [2^k X, 2^k X + 2^k - 1]. Si `cancelar` se activa a mitad devuelve false y la malla queda a medias.
+bool mallaDeVolumen(const vector<vector<vector<uint8_t>>>& volumen,
+                    const vector<vector<vector<glm::vec3>>>& volumen_color,
+                    MallaCPU& malla, glm::vec3 origen, const string& nombre,
+                    const atomic<bool>& cancelar) {
+    auto t0 = chrono::steady_clock::now();
+    // --- PASO 2: Generar malla con Marching Cubes ---
+    MarchingCubes(volumen, volumen_color, malla.vertices, malla.indices, ISO_MALLA, &cancelar);
+    if (cancelar) return false;
+    float escala = (float)(1 << malla.nivel);
+    glm::vec3 desplazamiento((escala - 1.0f) * 0.5f);
+    for (auto& v : malla.vertices)
+        v.position = (v.position + origen) * escala + desplazamiento;
+    auto t1 = chrono::steady_clock::now();
+
+    // --- PASO 3: Compartir vértices y reordenar para la caché de vértices de la GPU ---
+    soldarVertices(malla.vertices, malla.indices);
+    calcularNormales(malla.vertices, malla.indices);
+    EstadisticasCache antes = calcularEstadisticasCache(malla.indices, malla.vertices.size());
+    optimizarCacheVertices(malla.indices, malla.vertices.size(), &cancelar);
+    if (cancelar) return false;
+    optimizarOverdraw(malla.indices, malla.vertices);
+    optimizarOrdenVertices(malla.vertices, malla.indices);
+    EstadisticasCache despues = calcularEstadisticasCache(malla.indices, malla.vertices.size());
+    auto t2 = chrono::steady_clock::now();
+
+    if (malla.nivel > 0) return true;   // de los niveles gruesos solo se informa el total
+    cout << "Malla " << nombre << ": " << malla.indices.size() / 3 << " triangulos, "
+         << malla.vertices.size() << " vertices en "
+         << chrono::duration_cast<chrono::milliseconds>(t1 - t0).count() << " ms (+"
+         << chrono::duration_cast<chrono::milliseconds>(t2 - t1).count() << " ms optimizacion)" << endl;
+    cout << "  ACMR " << antes.acmr << " -> " << despues.acmr
+         << ", ATVR " << antes.atvr << " -> " << despues.atvr << endl;
+    return true;
+}
+
+// Triángulos de la malla como posiciones cuantizadas (1/32 de vóxel), empezando por el menor
+// vértice para no perder el sentido de giro; ordenados, dos mallas con la misma superficie coinciden.
+vector<array<long long, 9>> triangulosCanonicos(const vector<Vertex>& vertices, const vector<unsigned int>& indices) {
+    vector<array<long long, 9>> tris;
+    tris.reserve(indices.size() / 3);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        array<array<long long, 3>, 3> v;
+        for (int k = 0; k < 3; ++k) {
+            const glm::vec3& p = vertices[indices[t + k]].position;
+            v[k] = { llround(p.x * 32.0f), llround(p.y * 32.0f), llround(p.z * 32.0f) };
+        }
+        int primero = (int)(min_element(v.begin(), v.end()) - v.begin());
+        array<long long, 9> tri;
+        for (int k = 0; k < 3; ++k)
+            for (int c = 0; c < 3; ++c) tri[k * 3 + c] = v[(primero + k) % 3][c];
+        tris.push_back(tri);
+    }
+    sort(tris.begin(), tris.end());
+    return tris;
+}
+
+// Modo sin ventana: pasa una esfera sintética por la misma cadena que mallaDeVolumen y comprueba
+// que los reordenamientos conservan los triángulos y que el ACMR baja del umbral.
+const float ACMR_MAXIMO_ESFERA = 1.0f;
+int verificarOptimizacionMalla(int lado) {
+    float radio = lado * 0.4f, centro = (lado - 1) * 0.5f;
+    vector<vector<vector<uint8_t>>> volumen(lado, vector<vector<uint8_t>>(lado, vector<uint8_t>(lado, 0)));
+    vector<vector<vector<glm::vec3>>> volumen_color(lado, vector<vector<glm::vec3>>(lado, vector<glm::vec3>(lado, glm::vec3(1.0f))));
+    for (int z = 0; z < lado; ++z)
+        for (int y = 0; y < lado; ++y)
+            for (int x = 0; x < lado; ++x) {
+                glm::vec3 d = glm::vec3(x, y, z) - glm::vec3(centro);
+                volumen[z][y][x] = glm::dot(d, d) <= radio * radio ? 1 : 0;
+            }
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    MarchingCubes(volumen, volumen_color, vertices, indices, ISO_MALLA);
+    EstadisticasCache crudo = calcularEstadisticasCache(indices, vertices.size());
+    soldarVertices(vertices, indices);
+    EstadisticasCache antes = calcularEstadisticasCache(indices, vertices.size());
+    vector<array<long long, 9>> esperados = triangulosCanonicos(vertices, indices);
+    optimizarCacheVertices(indices, vertices.size());
+    optimizarOverdraw(indices, vertices);
+    optimizarOrdenVertices(vertices, indices);
+    EstadisticasCache despues = calcularEstadisticasCache(indices, vertices.size());
+
+    bool mismos = triangulosCanonicos(vertices, indices) == esperados;
+    cout << "Esfera " << lado << "^3: " << indices.size() / 3 << " triangulos, " << vertices.size() << " vertices" << endl;
+    cout << "  ACMR " << crudo.acmr << " (sin soldar) -> " << antes.acmr << " -> " << despues.acmr
+         << " (maximo " << ACMR_MAXIMO_ESFERA << "), ATVR " << despues.atvr << endl;
+    cout << "  Triangulos " << (mismos ? "iguales" : "DISTINTOS") << " antes y despues de reordenar" << endl;
+    bool ok = mismos && !esperados.empty() && despues.acmr < ACMR_MAXIMO_ESFERA;
+    cout << (ok ? "OK" : "FALLO") << endl;
+    return ok ? 0 : 1;
+}
+
+// ================== RECONSTRUCCIÓN PROGRESIVA ===================
+// Estado compartido entre el hilo que genera las mallas y el ciclo de render.
+struct ReconstruccionProgresiva {
+    mutex m;
+    unique_ptr<MallaCPU> lista;     // último nivel terminado que el ciclo aún no ha subido
+    atomic<bool> cancelar{ false }; // la selección cambió: no seguir refinando
+};
+
+// Las mallas se guardan por órgano (o por expresión) y nivel, así cualquier combinación de
+// máscaras reutiliza los órganos ya extraídos y solo genera los que faltan.
+string claveMalla(const Especimen& esp, const string& parte, int nivel) {
+    return "malla|" + esp.ruta + "|" + parte + "|1/" + to_string(1 << nivel) + "|iso " + to_string(ISO_MALLA);
+}
+
+size_t bytesMalla(const MallaCPU& malla) {
+    return malla.vertices.capacity() * sizeof(Vertex) + malla.indices.capacity() * sizeof(unsigned int);
+}
+
+// Malla de la caché o generada en este hilo y guardada. `armar` llena el volumen y su origen
+// y devuelve false si no hay nada que extraer. Devuelve nullptr si se canceló a mitad (una malla
+// incompleta no se guarda).
+template <typename ArmarVolumen>
+shared_ptr<const MallaCPU> mallaCacheada(const string& clave, const string& nombre, int nivel,
+                                         ArmarVolumen armar, const atomic<bool>& cancelar, bool& generada) {
+    shared_ptr<const MallaCPU> malla = cache_recursos.buscar<MallaCPU>(clave);
+    generada = !malla;
+    if (malla) return malla;
+    auto nueva = make_shared<MallaCPU>();
+    nueva->nivel = nivel;
+    vector<vector<vector<uint8_t>>> volumen;
+    vector<vector<vector<glm::vec3>>> volumen_color;
+    glm::vec3 origen(0.0f);
+    if (armar(volumen, volumen_color, origen) &&
+        !mallaDeVolumen(volumen, volumen_color, *nueva, origen, nombre, cancelar))
+        return nullptr;
+    nueva->vertices.shrink_to_fit();
+    nueva->indices.shrink_to_fit();
+    cache_recursos.guardar<MallaCPU>(clave, nueva, bytesMalla(*nueva));
+    return nueva;
+}
+
+void anexarMalla(MallaCPU& destino, const MallaCPU& parte) {
+    unsigned int base = (unsigned int)destino.vertices.size();
+    destino.vertices.insert(destino.vertices.end(), parte.vertices.begin(), parte.vertices.end());
+    destino.indices.reserve(destino.indices.size() + parte.indices.size());
+    for (unsigned int i : parte.indices) destino.indices.push_back(base + i);
+}
+
+// Se ejecuta en un hilo aparte: solo toca datos de CPU (el espécimen no cambia tras la carga y el
+// volumen de la expresión es inmutable). Empieza por el nivel más grueso que haga falta y va
+// publicando cada nivel hasta la resolución completa.
+void reconstruirProgresivo(shared_ptr<const Especimen> esp, vector<bool> activas, SeleccionCompuesta seleccion,
+                           shared_ptr<ReconstruccionProgresiva> estado) {
+    vector<string> partes;   // nombre de cada malla que forma la selección
+    if (seleccion.volumen) {
+        partes.push_back("expr " + seleccion.expresion);
+    }
+    else {
+        for (size_t mi = 0; mi < activas.size(); ++mi)
+            if (activas[mi]) partes.push_back(mascaras[mi]);
+    }
+    // Si un nivel ya está entero en la caché los más gruesos no aportan nada: se empieza por él
+    int nivelInicial = NIVELES_PIRAMIDE;
+    for (int nivel = 0; nivel < NIVELES_PIRAMIDE; ++nivel) {
+        bool completo = true;
+        for (const auto& parte : partes)
+            completo = completo && cache_recursos.contiene(claveMalla(*esp, parte, nivel));
+        if (completo) {
+            nivelInicial = nivel;
+            break;
+        }
+    }
+
+    // Para una expresión la pirámide se calcula aquí: reducir bits es casi gratis
+    vector<VolumenBits> piramideBits;
+    if (seleccion.volumen && nivelInicial > 0) {
+        const VolumenBits* fino = seleccion.volumen.get();
+        piramideBits.reserve(NIVELES_PIRAMIDE);
+        for (int k = 0; k < NIVELES_PIRAMIDE; ++k) {
+            piramideBits.push_back(reducirBits(*fino));
+            fino = &piramideBits.back();
+        }
+    }
+    glm::vec3 color = seleccion.volumen ? mascara_colors[seleccion.color] : glm::vec3(0);
+
+    for (int nivel = nivelInicial; nivel >= 0 && !estado->cancelar; --nivel) {
+        auto t0 = chrono::steady_clock::now();
+        unique_ptr<MallaCPU> malla(new MallaCPU());
+        malla->ruta = esp->ruta;
+        malla->activas = activas;
+        malla->expresion = seleccion.expresion;
+        malla->nivel = nivel;
+        int generadas = 0;
+
+        // --- PASO 1 y 2: volumen de cada parte y Marching Cubes (o la malla guardada) ---
+        if (seleccion.volumen) {
+            const VolumenBits& bits = (nivel == 0) ? *seleccion.volumen : piramideBits[nivel - 1];
+            bool generada;
+            auto parte = mallaCacheada(claveMalla(*esp, partes[0], nivel), seleccion.expresion, nivel,
+                [&](vector<vector<vector<uint8_t>>>& volumen, vector<vector<vector<glm::vec3>>>& volumen_color,
+                    glm::vec3&) {
+                    volumenDesdeBits(bits, color, volumen, volumen_color);
+                    return true;
+                }, estado->cancelar, generada);
+            if (!parte) break;
+            anexarMalla(*malla, *parte);
+            generadas += generada;
+        }
+        else {
+            for (size_t mi = 0; mi < activas.size() && !estado->cancelar; ++mi) {
+                if (!activas[mi]) continue;
+                bool generada;
+                auto parte = mallaCacheada(claveMalla(*esp, mascaras[mi], nivel), mascaras[mi], nivel,
+                    [&](vector<vector<vector<uint8_t>>>& volumen, vector<vector<vector<glm::vec3>>>& volumen_color,
+                        glm::vec3& origen) {
+                        return volumenDeOrgano(*esp, mi, nivel, origen, volumen, volumen_color);
+                    }, estado->cancelar, generada);
+                if (!parte) break;
+                anexarMalla(*malla, *parte);
+                generadas += generada;
+            }
+        }
+        if (estado->cancelar) break;
+
+        auto t1 = chrono::steady_clock::now();
+        cout << "Malla (1/" << (1 << nivel) << "): " << malla->indices.size() / 3 << " triangulos, "
+             << partes.size() - generadas << " de " << partes.size() << " partes desde la cache, "
+             << chrono::duration_cast<chrono::milliseconds>(t1 - t0).count() << " ms" << endl;
+        lock_guard<mutex> lock(estado->m);
+        estado->lista = move(malla);
+    }
+    cout << "Cache: " << cache_recursos.resumen() << endl;
+}
+
+int main(int argc, char** argv) {
+    // --dataset carpeta: PNGs de un espécimen; se puede repetir y la tecla n los recorre.
+    // --cache-mb N: presupuesto de la caché de especímenes y mallas (por defecto 2048 MB).
+    // --record sesion.txt: graba ratón, teclado, máscaras y expresiones de la sesión.
+    // --replay sesion.txt [--timings tiempos.csv]: la reproduce cuadro a cuadro en una ventana
+    // oculta, sin vsync, esperando cada malla, y guarda el tiempo de CPU de cada cuadro.
+    // Sin GPU se puede usar GL por software (Mesa: LIBGL_ALWAYS_SOFTWARE=1).
+    string rutaGrabacion, rutaReproduccion, rutaTiempos = "replay_tiempos.csv";
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg != "--record" && arg != "--replay" && arg != "--timings" && arg != "--dataset" && arg != "--cache-mb")
+            continue;
+        if (i + 1 >= argc || string(argv[i + 1]).compare(0, 2, "--") == 0) {
+            cerr << "Uso: " << arg << (arg == "--cache-mb" ? " MB" : arg == "--dataset" ? " carpeta" : " archivo")
+                 << " (falta el valor)" << endl;
+            return -1;
+        }
+        string valor = argv[++i];
+        if (arg == "--record") rutaGrabacion = valor;
+        else if (arg == "--replay") rutaReproduccion = valor;
+        else if (arg == "--timings") rutaTiempos = valor;
+        else if (arg == "--dataset") rutas_especimenes.push_back(valor);
+        else {
+            char* fin;
+            long long mb = strtoll(valor.c_str(), &fin, 10);
+            if (*fin || mb < 1 || mb > (1LL << 20)) {
+                cerr << "Uso: --cache-mb MB (entero entre 1 y 1048576)" << endl;
+                return -1;
+            }
+            cache_recursos.setPresupuesto((size_t)mb << 20);
+        }
+    }
+    if (rutas_especimenes.empty())
+        rutas_especimenes.push_back("ImgsFormateo/salida_pngs");
+
+    // --raycast-bench [cuadros]: raycasting de volumen sin ventana ni GPU (primer espécimen)
+    if (argc > 1 && string(argv[1]) == "--raycast-bench") {
+        long cuadros = 36;
+        if (argc > 2 && string(argv[2]).compare(0, 2, "--") != 0) {
+            char* fin;
+            cuadros = strtol(argv[2], &fin, 10);
+            if (*fin || cuadros < 1 || cuadros > 100000) {
+                cerr << "Uso: --raycast-bench [cuadros entre 1 y 100000] [--dataset carpeta]" << endl;
+                return -1;
+            }
+        }
+        return benchmarkRaycasting(rutas_especimenes[0], (int)cuadros, 1050, 600);
+    }
+    // --raycast-check: compara el salto de espacio vacío con el recorrido sin saltos (sin ventana)
+    if (argc > 1 && string(argv[1]) == "--raycast-check")
+        return verificarRaycasting(12, 420, 240);
+    // --mesh-check: comprueba la optimización de malla sobre una esfera de 96^3 (sin ventana)
+    if (argc > 1 && string(argv[1]) == "--mesh-check")
+        return verificarOptimizacionMalla(96);
+    bool reproduciendo = !rutaReproduccion.empty();
+    vector<EventoEntrada> eventos;
+    int cuadrosReproduccion = 0;
+    if (reproduciendo && !cargarGrabacion(rutaReproduccion, eventos, cuadrosReproduccion))
+        return -1;
+    if (!rutaGrabacion.empty() && !grabador.abrir(rutaGrabacion))
+        return -1;
+
     if (!glfwInit()) {
         cerr << "Error - INICIALIZAR GLFW" << endl;
         return -1;
@@ -351,6 +1207,7 @@ int main() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (reproduciendo) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
     int ancho = 2100, alto = 1200;
     GLFWwindow* ventana = glfwCreateWindow(ancho, alto, "Ranita bonita", nullptr, nullptr);
     if(!ventana){
@@ -360,158 +1217,290 @@ int main() {
     }
     glfwMakeContextCurrent(ventana);
     gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
-    glfwSetMouseButtonCallback(ventana, mouse_button_callback);
-    glfwSetCursorPosCallback(ventana, cursor_position_callback);
-    glfwSetScrollCallback(ventana, scroll_callback);
-    glfwSetKeyCallback(ventana, key_callback);
+    if (reproduciendo) {
+        glfwSwapInterval(0);   // sin vsync: el cuadro dura lo que tarda la CPU
+    }
+    else {
+        glfwSetMouseButtonCallback(ventana, mouse_button_callback);
+        glfwSetCursorPosCallback(ventana, cursor_position_callback);
+        glfwSetScrollCallback(ventana, scroll_callback);
+        glfwSetKeyCallback(ventana, key_callback);
+    }
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_PROGRAM_POINT_SIZE);
 
     GLuint shaderProgram = crearShaderProgram();
+    GLuint pointProgram = crearShaderProgram(pointVertexShaderSource, pointFragmentShaderSource);
+    GLuint quadProgram = crearShaderProgram(quadVertexShaderSource, quadFragmentShaderSource);
 
-    // --------- CARGA DE MÁSCARAS EN MEMORIA (solo una vez) -----------
-    puntos_por_mascara.resize(mascaras.size());
-    string ruta_base = "ImgsFormateo/salida_pngs";
-    string extension = "_frame_";
-    string extension2 = ".png";
+    // El espécimen se carga en segundo plano desde el ciclo principal (cambiar_especimen)
+    RaycasterVolumen raycaster;
+    shared_future<shared_ptr<const Especimen>> especimenEnCarga;
 
-    for (size_t mi = 0; mi < mascaras.size(); ++mi) {
-        string mascara = mascaras[mi];
-        cout << "Procesando mascara: " << mascara << endl;
-        for (int i = 1; i <= 136; ++i) {
-            string ruta_img =  ruta_base + "/" + mascara + extension + to_string(i) + extension2;
-            cv::Mat img = cv::imread(ruta_img, cv::IMREAD_GRAYSCALE);
-            if (img.empty()) continue;
-            // Si quieres filtro especial para alguna máscara, ponlo aquí
-            for (int y = 0; y < img.rows; ++y) {
-                for (int x = 0; x < img.cols; ++x) {
-                    if (img.at<uchar>(y, x) > 127) {
-                        puntos_por_mascara[mi].push_back({ static_cast<float>(x), static_cast<float>(y), static_cast<float>(i), mascara_colors[mi] });
-                    }
-                }
+    printMascaraStatus();
+    if (!reproduciendo) thread(leerConsola).detach();
+
+    // --------- BUFFERS: malla (triángulos) y vista previa (puntos) -----------
+    GLuint VAO, VBO, EBO;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec3)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(2 * sizeof(glm::vec3)));
+
+    GLuint puntosVAO, puntosVBO;
+    glGenVertexArrays(1, &puntosVAO);
+    glGenBuffers(1, &puntosVBO);
+    glBindVertexArray(puntosVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, puntosVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(PuntoGPU), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, sizeof(PuntoGPU), (void*)(3 * sizeof(uint16_t)));
+    glBindVertexArray(0);
+
+    glUseProgram(pointProgram);
+    glUniform3fv(glGetUniformLocation(pointProgram, "mascaraColores"), (GLsizei)mascaras.size(),
+                 glm::value_ptr(mascara_colors[0]));
+
+    // Textura donde se sube la imagen del raycasting (a media resolución para mantenerlo interactivo)
+    ImagenRGBA imagenVolumen;
+    imagenVolumen.ancho = ancho / 2;
+    imagenVolumen.alto = alto / 2;
+    GLuint volumenTex, quadVAO;
+    glGenTextures(1, &volumenTex);
+    glBindTexture(GL_TEXTURE_2D, volumenTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, imagenVolumen.ancho, imagenVolumen.alto, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glGenVertexArrays(1, &quadVAO);
+    glm::mat4 ultimaMVP(0.0f);        // solo se vuelve a trazar si cambia la cámara o las máscaras
+    vector<bool> ultimasActivas;
+
+    glDisable(GL_CULL_FACE);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    size_t numIndices = 0, numPuntos = 0;
+    bool mallaLista = false;      // la malla en el VBO corresponde a la selección actual
+    future<void> mallaEnCurso;
+    shared_ptr<ReconstruccionProgresiva> reconstruccion;
+    int cuadro = 0;
+    size_t siguienteEvento = 0;
+    vector<TiemposCuadro> tiempos;
+    auto msDesde = [](chrono::steady_clock::time_point t) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+    };
+
+    // =============== CICLO PRINCIPAL: vista previa inmediata, malla cuando esté lista ============
+    while (!glfwWindowShouldClose(ventana) && (!reproduciendo || cuadro < cuadrosReproduccion)) {
+        auto inicioCuadro = chrono::steady_clock::now();
+        double esperaFondo = 0.0;   // reproducción: espera a la carga del espécimen y a las mallas
+        grabador.cuadro = cuadro;
+        glfwPollEvents();
+        // Los eventos grabados entran en el mismo cuadro y en el mismo orden que en la sesión
+        while (siguienteEvento < eventos.size() && eventos[siguienteEvento].cuadro <= cuadro)
+            aplicarEvento(eventos[siguienteEvento++]);
+        {
+            vector<string> lineas;
+            {
+                lock_guard<mutex> lock(mutex_consola);
+                lineas.swap(lineas_consola);
             }
+            for (const auto& linea : lineas)
+                procesarExpresion(linea);
         }
-    }
 
-    printMascaraStatus();
+        // Cambio de espécimen: se sigue mostrando el anterior hasta que el nuevo salga de la caché
+        // o termine de cargarse en segundo plano.
+        if (cambiar_especimen) {
+            especimenEnCarga = pedirEspecimen(rutas_especimenes[especimen_actual]);
+            cambiar_especimen = false;
+            if (reproduciendo) {
+                auto t0 = chrono::steady_clock::now();
+                especimenEnCarga.wait();
+                esperaFondo += msDesde(t0);
+            }
+        }
+        if (especimenEnCarga.valid() &&
+            especimenEnCarga.wait_for(chrono::seconds(0)) == future_status::ready) {
+            shared_ptr<const Especimen> cargado = especimenEnCarga.get();
+            especimenEnCarga = shared_future<shared_ptr<const Especimen>>();
+            if (cargado && cargado != especimen) {
+                // El espécimen en pantalla queda fijado en la caché: las mallas que se generan
+                // mientras se mira son más recientes y lo expulsarían antes que a nada.
+                if (especimen) cache_recursos.soltar(claveEspecimen(especimen->ruta));
+                if (!cache_recursos.contiene(claveEspecimen(cargado->ruta)))
+                    cache_recursos.guardar<Especimen>(claveEspecimen(cargado->ruta), cargado, cargado->bytes());
+                cache_recursos.fijar(claveEspecimen(cargado->ruta));
+                especimen = cargado;
+                raycaster.setVolumen(&especimen->etiquetas);
+                ultimasActivas.clear();   // volver a trazar el volumen
+                if (compuesta.volumen) {
+                    compuesta = SeleccionCompuesta();   // el volumen de la expresión es del espécimen anterior
+                    cout << "Expresion desactivada al cambiar de especimen" << endl;
+                }
+                preview_sucio = true;
+                recargar_malla = true;
+                cout << "Especimen activo: " << especimen->ruta << " (cache: " << cache_recursos.resumen() << ")" << endl;
+            }
+        }
 
-    // =============== CICLO PRINCIPAL: solo combinamos las máscaras activas ============
-    while (true) {
-        // Combinar puntos de las máscaras activas
-        vector<Punto3D> puntos_totales;
-        for (size_t mi = 0; mi < mascaras.size(); ++mi)
-            if (mascara_activa[mi])
-                puntos_totales.insert(puntos_totales.end(), puntos_por_mascara[mi].begin(), puntos_por_mascara[mi].end());
-        cout << "Puntos totales: " << puntos_totales.size() << endl;
-
-        // --- PASO 1: Calcular el volumen 3D binario y color ---
-        int maxX = 0, maxY = 0, maxZ = 0;
-        for (const auto& p : puntos_totales) {
-            maxX = std::max(maxX, (int)p.x);
-            maxY = std::max(maxY, (int)p.y);
-            maxZ = std::max(maxZ, (int)p.z);
+        // Tras cargar o cambiar máscaras se suben los puntos de inmediato y se muestran
+        // hasta que la malla completa esté disponible.
+        if (preview_sucio && especimen) {
+            auto t0 = chrono::steady_clock::now();
+            vector<PuntoGPU> puntos = compuesta.volumen ? construirPuntosPreview(*compuesta.volumen, compuesta.color)
+                                                        : construirPuntosPreview(*especimen, mascara_activa);
+            glBindBuffer(GL_ARRAY_BUFFER, puntosVBO);
+            glBufferData(GL_ARRAY_BUFFER, puntos.size() * sizeof(PuntoGPU), puntos.data(), GL_DYNAMIC_DRAW);
+            numPuntos = puntos.size();
+            mallaLista = false;
+            preview_sucio = false;
+            auto t1 = chrono::steady_clock::now();
+            cout << "Vista previa: " << numPuntos << " puntos subidos en "
+                 << chrono::duration_cast<chrono::milliseconds>(t1 - t0).count() << " ms" << endl;
+        }
+        // Una reconstrucción en curso se cancela tras su nivel actual y la nueva arranca al terminar.
+        bool enCurso = mallaEnCurso.valid() &&
+                       mallaEnCurso.wait_for(chrono::seconds(0)) != future_status::ready;
+        if (recargar_malla && enCurso) {
+            reconstruccion->cancelar = true;
         }
-        int VOLUME_WIDTH = maxX + 1;
-        int VOLUME_HEIGHT = maxY + 1;
-        int VOLUME_DEPTH = maxZ + 1;
-
-        vector<vector<vector<uint8_t>>> volumen(
-            VOLUME_DEPTH, vector<vector<uint8_t>>(VOLUME_HEIGHT, vector<uint8_t>(VOLUME_WIDTH, 0))
-        );
-        vector<vector<vector<glm::vec3>>> volumen_color(
-            VOLUME_DEPTH, vector<vector<glm::vec3>>(VOLUME_HEIGHT, vector<glm::vec3>(VOLUME_WIDTH, glm::vec3(0)))
-        );
-        for (const auto& p : puntos_totales) {
-            int x = static_cast<int>(p.x);
-            int y = static_cast<int>(p.y);
-            int z = static_cast<int>(p.z);
-            if (x >= 0 && x < VOLUME_WIDTH &&
-                y >= 0 && y < VOLUME_HEIGHT &&
-                z >= 0 && z < VOLUME_DEPTH)
+        // Subir el último nivel terminado (del más grueso al completo)
+        if (reconstruccion) {
+            unique_ptr<MallaCPU> malla;
             {
-                volumen[z][y][x] = 1;
-                volumen_color[z][y][x] = p.color;
+                lock_guard<mutex> lock(reconstruccion->m);
+                malla = move(reconstruccion->lista);
+            }
+            // Si la selección cambió mientras se generaba, la malla ya no corresponde: sigue la vista previa
+            if (malla && especimen && malla->ruta == especimen->ruta &&
+                malla->activas == mascara_activa && malla->expresion == compuesta.expresion) {
+                glBindBuffer(GL_ARRAY_BUFFER, VBO);
+                glBufferData(GL_ARRAY_BUFFER, malla->vertices.size() * sizeof(Vertex), malla->vertices.data(), GL_STATIC_DRAW);
+                glBindVertexArray(VAO);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, malla->indices.size() * sizeof(unsigned int), malla->indices.data(), GL_STATIC_DRAW);
+                glBindVertexArray(0);
+                numIndices = malla->indices.size();
+                mallaLista = true;
+            }
+        }
+        if (!enCurso && mallaEnCurso.valid())
+            mallaEnCurso.get();
+        // El hilo terminó; si dejó un último nivel sin subir se recoge en el siguiente cuadro
+        if (reconstruccion && !mallaEnCurso.valid() && !reconstruccion->lista)
+            reconstruccion.reset();
+        if (recargar_malla && especimen && !mallaEnCurso.valid() && !reconstruccion) {
+            reconstruccion = make_shared<ReconstruccionProgresiva>();
+            mallaEnCurso = async(launch::async, reconstruirProgresivo, especimen, mascara_activa, compuesta,
+                                 reconstruccion);
+            recargar_malla = false;
+            // En la reproducción la malla final siempre está lista en el cuadro siguiente,
+            // así dos builds procesan exactamente la misma secuencia de mallas.
+            if (reproduciendo) {
+                auto t0 = chrono::steady_clock::now();
+                mallaEnCurso.wait();
+                esperaFondo += msDesde(t0);
             }
         }
+        TiemposCuadro tiempo;
+        tiempo.actualizar = msDesde(inicioCuadro) - esperaFondo;
+        tiempo.reconstruir = esperaFondo;
+        auto inicioDibujo = chrono::steady_clock::now();
+
+        glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // --- PASO 2: Generar malla con Marching Cubes ---
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        MarchingCubes(volumen, volumen_color, vertices, indices);
-        calcularNormales(vertices, indices);
-
-        GLuint VAO, VBO, EBO;
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec3)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(2 * sizeof(glm::vec3)));
-
-        glDisable(GL_CULL_FACE);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-        // Render loop
-        bool recargar = false;
-        while (!glfwWindowShouldClose(ventana)) {
-            glfwPollEvents();
-            if (glfwWindowShouldClose(ventana) == 2) { // señal especial
-                glfwSetWindowShouldClose(ventana, 0);
-                recargar = true;
-                break;
+        glm::mat4 model, view, proj;
+        glm::vec3 camaraPos;
+        calcularCamara(ancho, alto, model, view, proj, camaraPos);
+
+        if (vista_volumen) {
+            glm::mat4 mvp = proj * view * model;
+            if (mvp != ultimaMVP || ultimasActivas != mascara_activa) {
+                raycaster.setTransferencia(mascara_colors, mascara_opacidad, mascara_activa);
+                raycaster.render(mvp, imagenVolumen, glm::vec3(0.05f, 0.05f, 0.1f));
+                glBindTexture(GL_TEXTURE_2D, volumenTex);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imagenVolumen.ancho, imagenVolumen.alto,
+                                GL_RGBA, GL_UNSIGNED_BYTE, imagenVolumen.pixeles.data());
+                ultimaMVP = mvp;
+                ultimasActivas = mascara_activa;
             }
-            glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glUseProgram(shaderProgram);
-
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(translateX, translateY, 0.0f));
-            model = glm::rotate(model, glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::rotate(model, glm::radians(pitch), glm::vec3(1.0f, 0.0f, 0.0f));
-            model = glm::scale(model, glm::vec3(zoom));
-            model = glm::translate(model, glm::vec3(-128.0f, -128.0f, -68.0f));
-            glm::vec3 modeloCentro(128.0f, 128.0f, 68.0f);
-            glm::vec3 camaraPos = modeloCentro + glm::vec3(0, 0, 500);
-            glm::vec3 camaraFrente = modeloCentro;
-            glm::vec3 camaraArriba = glm::vec3(0, 1, 0);
-            glm::mat4 view = glm::lookAt(camaraPos, camaraFrente, camaraArriba);
-            glm::mat4 proj = glm::perspective(glm::radians(60.0f), ancho / float(alto), 0.1f, 2000.0f);
-            GLuint modelLoc = glGetUniformLocation(shaderProgram, "model");
-            GLuint viewLoc = glGetUniformLocation(shaderProgram, "view");
-            GLuint projLoc = glGetUniformLocation(shaderProgram, "projection");
+            glDisable(GL_DEPTH_TEST);
+            glUseProgram(quadProgram);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, volumenTex);
+            glUniform1i(glGetUniformLocation(quadProgram, "imagen"), 0);
+            glBindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glEnable(GL_DEPTH_TEST);
+        }
+        else {
+            GLuint programa = mallaLista ? shaderProgram : pointProgram;
+            glUseProgram(programa);
+            GLuint modelLoc = glGetUniformLocation(programa, "model");
+            GLuint viewLoc = glGetUniformLocation(programa, "view");
+            GLuint projLoc = glGetUniformLocation(programa, "projection");
             glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
             glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
             glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(proj));
 
-            // Luz y cámara para Phong
-            GLuint lightPosLoc = glGetUniformLocation(shaderProgram, "lightPos");
-            GLuint viewPosLoc = glGetUniformLocation(shaderProgram, "viewPos");
-            glUniform3f(lightPosLoc, 128.0f, 128.0f, 200.0f);
-            glUniform3f(viewPosLoc, camaraPos.x, camaraPos.y, camaraPos.z);
+            if (mallaLista) {
+                // Luz y cámara para Phong
+                GLuint lightPosLoc = glGetUniformLocation(shaderProgram, "lightPos");
+                GLuint viewPosLoc = glGetUniformLocation(shaderProgram, "viewPos");
+                glUniform3f(lightPosLoc, 128.0f, 128.0f, 200.0f);
+                glUniform3f(viewPosLoc, camaraPos.x, camaraPos.y, camaraPos.z);
 
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-
-            glfwSwapBuffers(ventana);
+                glBindVertexArray(VAO);
+                glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0);
+            }
+            else {
+                // Diámetro en píxeles de un vóxel a distancia w (x1.5 para cubrir las esquinas del disco)
+                float tamPunto = 1.5f * zoom * proj[1][1] * 0.5f * alto;
+                glUniform1f(glGetUniformLocation(pointProgram, "tamPunto"), tamPunto);
+                glBindVertexArray(puntosVAO);
+                glDrawArrays(GL_POINTS, 0, (GLsizei)numPuntos);
+            }
         }
-        glDeleteBuffers(1, &VBO);
-        glDeleteBuffers(1, &EBO);
-        glDeleteVertexArrays(1, &VAO);
-        if (!recargar) break;
+        tiempo.dibujar = msDesde(inicioDibujo);
+
+        auto inicioPresentar = chrono::steady_clock::now();
+        glfwSwapBuffers(ventana);
+        tiempo.presentar = msDesde(inicioPresentar);
+        if (reproduciendo) tiempos.push_back(tiempo);
+        ++cuadro;
+    }
+    grabador.cuadro = cuadro;
+    grabador.cerrar();
+    if (reproduciendo) {
+        escribirTiempos(rutaTiempos, tiempos);
+        resumirTiempos(tiempos);
+        cout << "Tiempos por cuadro guardados en " << rutaTiempos << endl;
     }
+    // Al cerrar no se espera a que termine la extracción en curso
+    if (reconstruccion) reconstruccion->cancelar = true;
+    if (mallaEnCurso.valid()) mallaEnCurso.wait();
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteTextures(1, &volumenTex);
+    glDeleteVertexArrays(1, &quadVAO);
+    glDeleteProgram(quadProgram);
+    glDeleteBuffers(1, &puntosVBO);
+    glDeleteVertexArrays(1, &puntosVAO);
+    glDeleteProgram(pointProgram);
     glDeleteProgram(shaderProgram);
     glfwDestroyWindow(ventana);
     glfwTerminate();
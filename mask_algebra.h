@@ -0,0 +1,259 @@
+// Álgebra de máscaras sobre volúmenes empaquetados en bits (1 bit por vóxel)
+// Unión, intersección, diferencia, dilatación y erosión palabra a palabra (64 vóxeles por operación)
+// y un pequeño intérprete de expresiones: "muscle - skeleton", "blood & liver", "dilate(nerve, 2)"
+
+#ifndef MASK_ALGEBRA_H
+#define MASK_ALGEBRA_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bit x de la fila (y, z) = palabra x / 64, bit x % 64. Los bits sobrantes al final de cada
+// fila se mantienen siempre a cero para que las operaciones no inventen vóxeles fuera del volumen.
+struct VolumenBits {
+    int ancho = 0, alto = 0, profundo = 0;
+    int palabrasFila = 0;
+    std::vector<uint64_t> bits;
+
+    void redimensionar(int w, int h, int d) {
+        ancho = w; alto = h; profundo = d;
+        palabrasFila = (w + 63) / 64;
+        bits.assign((size_t)palabrasFila * h * d, 0);
+    }
+    uint64_t* fila(int y, int z) { return &bits[((size_t)z * alto + y) * palabrasFila]; }
+    const uint64_t* fila(int y, int z) const { return &bits[((size_t)z * alto + y) * palabrasFila]; }
+    bool get(int x, int y, int z) const { return (fila(y, z)[x >> 6] >> (x & 63)) & 1; }
+    void set(int x, int y, int z) { fila(y, z)[x >> 6] |= 1ull << (x & 63); }
+    size_t contar() const {
+        size_t n = 0;
+        for (uint64_t w : bits) {
+            // popcount portable (MSVC y GCC), el compilador lo reduce a POPCNT si está disponible
+            w = w - ((w >> 1) & 0x5555555555555555ull);
+            w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+            w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+            n += (size_t)((w * 0x0101010101010101ull) >> 56);
+        }
+        return n;
+    }
+    // Bits válidos de la última palabra de cada fila
+    uint64_t mascaraCola() const {
+        int resto = ancho & 63;
+        return resto ? ((1ull << resto) - 1) : ~0ull;
+    }
+};
+
+// Los bucles sobre `bits` son planos y sin dependencias para que el compilador los vectorice.
+inline void unionBits(VolumenBits& a, const VolumenBits& b) {
+    uint64_t* pa = a.bits.data();
+    const uint64_t* pb = b.bits.data();
+    for (size_t i = 0, n = a.bits.size(); i < n; ++i) pa[i] |= pb[i];
+}
+inline void interseccionBits(VolumenBits& a, const VolumenBits& b) {
+    uint64_t* pa = a.bits.data();
+    const uint64_t* pb = b.bits.data();
+    for (size_t i = 0, n = a.bits.size(); i < n; ++i) pa[i] &= pb[i];
+}
+inline void diferenciaBits(VolumenBits& a, const VolumenBits& b) {
+    uint64_t* pa = a.bits.data();
+    const uint64_t* pb = b.bits.data();
+    for (size_t i = 0, n = a.bits.size(); i < n; ++i) pa[i] &= ~pb[i];
+}
+
+// Dilatación (OR) o erosión (AND) con el cubo 3x3x3, separada en las pasadas x, y, z.
+// Fuera del volumen se considera vacío, así que la erosión también come los bordes.
+inline void morfologiaBits(VolumenBits& v, bool dilatar) {
+    const int W = v.palabrasFila;
+    const uint64_t cola = v.mascaraCola();
+    std::vector<uint64_t> tmp(v.bits.size());
+
+    // Pasada x: vecinos x-1 y x+1 con acarreo entre palabras
+    for (int z = 0; z < v.profundo; ++z)
+        for (int y = 0; y < v.alto; ++y) {
+            const uint64_t* f = v.fila(y, z);
+            uint64_t* o = &tmp[((size_t)z * v.alto + y) * W];
+            for (int i = 0; i < W; ++i) {
+                uint64_t prev = (i > 0) ? f[i - 1] : 0;
+                uint64_t next = (i + 1 < W) ? f[i + 1] : 0;
+                uint64_t izq = (f[i] << 1) | (prev >> 63);
+                uint64_t der = (f[i] >> 1) | (next << 63);
+                o[i] = dilatar ? (f[i] | izq | der) : (f[i] & izq & der);
+            }
+            o[W - 1] &= cola;
+        }
+
+    // Pasada y: filas vecinas del mismo corte
+    for (int z = 0; z < v.profundo; ++z)
+        for (int y = 0; y < v.alto; ++y) {
+            const uint64_t* c = &tmp[((size_t)z * v.alto + y) * W];
+            const uint64_t* a = (y > 0) ? c - W : nullptr;
+            const uint64_t* b = (y + 1 < v.alto) ? c + W : nullptr;
+            uint64_t* o = v.fila(y, z);
+            for (int i = 0; i < W; ++i) {
+                uint64_t va = a ? a[i] : 0, vb = b ? b[i] : 0;
+                o[i] = dilatar ? (c[i] | va | vb) : (c[i] & va & vb);
+            }
+        }
+
+    // Pasada z: cortes vecinos, fila a fila
+    const size_t corte = (size_t)v.alto * W;
+    std::copy(v.bits.begin(), v.bits.end(), tmp.begin());
+    for (int z = 0; z < v.profundo; ++z) {
+        const uint64_t* c = &tmp[z * corte];
+        const uint64_t* a = (z > 0) ? c - corte : nullptr;
+        const uint64_t* b = (z + 1 < v.profundo) ? c + corte : nullptr;
+        uint64_t* o = &v.bits[z * corte];
+        for (size_t i = 0; i < corte; ++i) {
+            uint64_t va = a ? a[i] : 0, vb = b ? b[i] : 0;
+            o[i] = dilatar ? (c[i] | va | vb) : (c[i] & va & vb);
+        }
+    }
+}
+
+// Mitad de resolución por eje: un vóxel grueso está ocupado si lo está alguno de sus 2x2x2 hijos.
+inline VolumenBits reducirBits(const VolumenBits& fino) {
+    VolumenBits grueso;
+    grueso.redimensionar((fino.ancho + 1) / 2, (fino.alto + 1) / 2, (fino.profundo + 1) / 2);
+    std::vector<uint64_t> filaOr(fino.palabrasFila);
+    for (int z = 0; z < grueso.profundo; ++z)
+        for (int y = 0; y < grueso.alto; ++y) {
+            std::fill(filaOr.begin(), filaOr.end(), 0);
+            for (int dz = 0; dz < 2; ++dz)
+                for (int dy = 0; dy < 2; ++dy) {
+                    int fy = 2 * y + dy, fz = 2 * z + dz;
+                    if (fy >= fino.alto || fz >= fino.profundo) continue;
+                    const uint64_t* f = fino.fila(fy, fz);
+                    for (int i = 0; i < fino.palabrasFila; ++i) filaOr[i] |= f[i];
+                }
+            // Pares de bits en x -> un bit
+            uint64_t* o = grueso.fila(y, z);
+            for (int x = 0; x < grueso.ancho; ++x) {
+                int fx = 2 * x;
+                if ((filaOr[fx >> 6] >> (fx & 63)) & 3) o[x >> 6] |= 1ull << (x & 63);
+            }
+        }
+    return grueso;
+}
+
+// ================== EXPRESIONES DE MÁSCARAS ======================
+// Más pasos de dilatación/erosión no tienen sentido en un volumen de ~256 vóxeles por eje
+// y congelarían la consola.
+const int MAX_PASOS_MORFOLOGIA = 64;
+
+// expr   := term (('|' | '+' | '-') term)*
+// term   := factor ('&' factor)*
+// factor := nombre | '(' expr ')' | ('dilate' | 'erode') '(' expr [',' n] ')'
+// Los nombres son los de `mascaras` sin el sufijo "Masks" y sin distinguir mayúsculas.
+class ExpresionMascaras {
+public:
+    ExpresionMascaras(const std::vector<std::string>& nombres, const std::vector<VolumenBits>& volumenes)
+        : nombres(nombres), volumenes(volumenes) {}
+
+    // Devuelve false y deja el motivo en `error` si la expresión no es válida.
+    bool evaluar(const std::string& expresion, VolumenBits& resultado) {
+        texto = expresion;
+        pos = 0;
+        error.clear();
+        primeraMascara = -1;
+        if (!expr(resultado)) return false;
+        saltarEspacios();
+        if (pos < texto.size()) return fallar("caracter inesperado '" + std::string(1, texto[pos]) + "'");
+        return true;
+    }
+
+    std::string error;
+    int primeraMascara = -1;   // primera máscara que aparece (para el color del resultado)
+
+private:
+    const std::vector<std::string>& nombres;
+    const std::vector<VolumenBits>& volumenes;
+    std::string texto;
+    size_t pos = 0;
+
+    bool fallar(const std::string& msg) {
+        if (error.empty()) error = msg + " (posicion " + std::to_string(pos) + ")";
+        return false;
+    }
+    void saltarEspacios() {
+        while (pos < texto.size() && std::isspace((unsigned char)texto[pos])) ++pos;
+    }
+    bool aceptar(char c) {
+        saltarEspacios();
+        if (pos < texto.size() && texto[pos] == c) { ++pos; return true; }
+        return false;
+    }
+    std::string identificador() {
+        saltarEspacios();
+        size_t inicio = pos;
+        while (pos < texto.size() && (std::isalnum((unsigned char)texto[pos]) || texto[pos] == '_')) ++pos;
+        std::string id = texto.substr(inicio, pos - inicio);
+        std::transform(id.begin(), id.end(), id.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return id;
+    }
+
+    bool expr(VolumenBits& r) {
+        if (!term(r)) return false;
+        while (true) {
+            char op;
+            if (aceptar('|')) op = '|';
+            else if (aceptar('+')) op = '|';
+            else if (aceptar('-')) op = '-';
+            else return true;
+            VolumenBits b;
+            if (!term(b)) return false;
+            if (op == '|') unionBits(r, b);
+            else diferenciaBits(r, b);
+        }
+    }
+    bool term(VolumenBits& r) {
+        if (!factor(r)) return false;
+        while (aceptar('&')) {
+            VolumenBits b;
+            if (!factor(b)) return false;
+            interseccionBits(r, b);
+        }
+        return true;
+    }
+    bool factor(VolumenBits& r) {
+        if (aceptar('(')) {
+            if (!expr(r)) return false;
+            return aceptar(')') || fallar("falta ')'");
+        }
+        std::string id = identificador();
+        if (id.empty()) return fallar("se esperaba una mascara");
+        if (id == "dilate" || id == "erode") {
+            if (!aceptar('(')) return fallar("falta '(' tras " + id);
+            if (!expr(r)) return false;
+            int pasos = 1;
+            if (aceptar(',')) {
+                saltarEspacios();
+                size_t inicio = pos;
+                pasos = 0;
+                while (pos < texto.size() && std::isdigit((unsigned char)texto[pos])) {
+                    pasos = pasos * 10 + (texto[pos] - '0');
+                    if (pasos > MAX_PASOS_MORFOLOGIA)
+                        return fallar("numero de pasos fuera de rango (maximo " + std::to_string(MAX_PASOS_MORFOLOGIA) + ")");
+                    ++pos;
+                }
+                if (inicio == pos) return fallar("se esperaba un numero de pasos");
+            }
+            if (!aceptar(')')) return fallar("falta ')'");
+            for (int i = 0; i < pasos; ++i) morfologiaBits(r, id == "dilate");
+            return true;
+        }
+        for (size_t m = 0; m < nombres.size(); ++m) {
+            std::string n = nombres[m];
+            std::transform(n.begin(), n.end(), n.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+            if (n == id || n == id + "masks") {
+                r = volumenes[m];
+                if (primeraMascara < 0) primeraMascara = (int)m;
+                return true;
+            }
+        }
+        return fallar("mascara desconocida '" + id + "'");
+    }
+};
+
+#endif
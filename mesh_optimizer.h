@@ -0,0 +1,249 @@
+// Optimización de la malla extraída para la caché de vértices de la GPU
+// Marching Cubes emite los triángulos en orden de barrido y sin compartir vértices:
+//   1. soldarVertices:         une los vértices repetidos de aristas compartidas
+//   2. optimizarCacheVertices: reordena triángulos (Forsyth) para reutilizar vértices ya transformados
+//   3. optimizarOverdraw:      reordena grupos de triángulos de afuera hacia adentro (estilo Tipsy)
+//   4. optimizarOrdenVertices: renumera vértices en orden de primer uso (localidad de lectura)
+
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Tamaño de la caché post-transformación que se simula (FIFO, típico de GPUs de escritorio)
+const int TAM_CACHE_VERTICES = 16;
+
+struct EstadisticasCache {
+    float acmr = 0.0f;   // vértices transformados por triángulo (ideal ~0.5, peor caso 3)
+    float atvr = 0.0f;   // vértices transformados por vértice único (ideal 1)
+};
+
+// Simula una caché FIFO sobre el índice de la malla.
+inline EstadisticasCache calcularEstadisticasCache(const std::vector<unsigned int>& indices, size_t numVertices,
+                                                   int tamCache = TAM_CACHE_VERTICES) {
+    EstadisticasCache est;
+    if (indices.empty() || numVertices == 0) return est;
+    // Marca de tiempo de entrada de cada vértice en la caché; sigue en caché mientras fallos - marca <= tamCache
+    std::vector<long long> entrada(numVertices, -(long long)tamCache - 1);
+    std::vector<char> usado(numVertices, 0);
+    long long fallos = 0;
+    size_t unicos = 0;
+    for (unsigned int v : indices) {
+        if (fallos - entrada[v] > tamCache) {
+            entrada[v] = fallos;
+            ++fallos;
+        }
+        if (!usado[v]) { usado[v] = 1; ++unicos; }
+    }
+    est.acmr = (float)fallos / (indices.size() / 3);
+    est.atvr = (float)fallos / unicos;
+    return est;
+}
+
+// Une vértices con la misma posición (cuantizada a 1/32 de vóxel) y elimina triángulos degenerados.
+// V debe tener un miembro `position`; el resto de atributos se toma del primer vértice soldado.
+template <typename V>
+void soldarVertices(std::vector<V>& vertices, std::vector<unsigned int>& indices) {
+    std::unordered_map<uint64_t, unsigned int> mapa;
+    mapa.reserve(vertices.size() / 4);
+    std::vector<unsigned int> remapeo(vertices.size());
+    size_t n = 0;
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const glm::vec3 p = vertices[i].position;
+        uint64_t clave = ((uint64_t)(uint32_t)std::lround(p.x * 32.0f) & 0x1FFFFF)
+                       | (((uint64_t)(uint32_t)std::lround(p.y * 32.0f) & 0x1FFFFF) << 21)
+                       | (((uint64_t)(uint32_t)std::lround(p.z * 32.0f) & 0x1FFFFF) << 42);
+        auto it = mapa.find(clave);
+        if (it != mapa.end()) {
+            remapeo[i] = it->second;
+        }
+        else {
+            mapa.emplace(clave, (unsigned int)n);
+            vertices[n] = vertices[i];
+            remapeo[i] = (unsigned int)n++;
+        }
+    }
+    vertices.resize(n);
+    size_t escritos = 0;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        unsigned int a = remapeo[indices[t]], b = remapeo[indices[t + 1]], c = remapeo[indices[t + 2]];
+        if (a == b || b == c || a == c) continue;
+        indices[escritos++] = a;
+        indices[escritos++] = b;
+        indices[escritos++] = c;
+    }
+    indices.resize(escritos);
+}
+
+// Reordena triángulos con el algoritmo de Tom Forsyth ("Linear-Speed Vertex Cache Optimisation").
+// Si `cancelar` se activa, deja el índice como estaba y vuelve en cuanto lo detecta.
+inline void optimizarCacheVertices(std::vector<unsigned int>& indices, size_t numVertices,
+                                   const std::atomic<bool>* cancelar = nullptr) {
+    const int TAM_CACHE_LRU = 32;
+    size_t numTriangulos = indices.size() / 3;
+    if (numTriangulos == 0) return;
+
+    // Triángulos que usa cada vértice (CSR)
+    std::vector<unsigned int> inicio(numVertices + 1, 0);
+    for (unsigned int v : indices) ++inicio[v + 1];
+    for (size_t v = 0; v < numVertices; ++v) inicio[v + 1] += inicio[v];
+    std::vector<unsigned int> adyacentes(indices.size());
+    std::vector<unsigned int> restantes(numVertices, 0);   // triángulos aún sin emitir por vértice
+    for (size_t t = 0; t < numTriangulos; ++t)
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = indices[t * 3 + k];
+            adyacentes[inicio[v] + restantes[v]++] = (unsigned int)t;
+        }
+
+    auto puntaje = [&](int posCache, unsigned int valencia) -> float {
+        if (valencia == 0) return -1.0f;
+        float s = 0.0f;
+        if (posCache >= 0) {
+            if (posCache < 3) s = 0.75f;
+            else s = std::pow(1.0f - (float)(posCache - 3) / (TAM_CACHE_LRU - 3), 1.5f);
+        }
+        return s + 2.0f * std::pow((float)valencia, -0.5f);
+    };
+
+    std::vector<float> puntajeVertice(numVertices);
+    for (size_t v = 0; v < numVertices; ++v) puntajeVertice[v] = puntaje(-1, restantes[v]);
+    std::vector<char> emitido(numTriangulos, 0);
+
+    std::vector<unsigned int> salida;
+    salida.reserve(indices.size());
+    std::vector<unsigned int> cache, nuevaCache;
+    cache.reserve(TAM_CACHE_LRU + 3);
+    nuevaCache.reserve(TAM_CACHE_LRU + 3);
+    size_t cursor = 0;   // para buscar el siguiente triángulo cuando la caché no ofrece candidatos
+    long long mejor = -1;
+
+    while (salida.size() < indices.size()) {
+        if (cancelar && (salida.size() / 3) % 4096 == 0 && *cancelar) return;
+        if (mejor < 0) {
+            while (cursor < numTriangulos && emitido[cursor]) ++cursor;
+            if (cursor == numTriangulos) break;
+            mejor = (long long)cursor;
+        }
+        size_t t = (size_t)mejor;
+        emitido[t] = 1;
+        const unsigned int* tri = &indices[t * 3];
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = tri[k];
+            salida.push_back(v);
+            // Quitar el triángulo de la lista de pendientes del vértice
+            unsigned int* ady = &adyacentes[inicio[v]];
+            unsigned int n = restantes[v];
+            for (unsigned int j = 0; j < n; ++j)
+                if (ady[j] == t) { std::swap(ady[j], ady[n - 1]); break; }
+            --restantes[v];
+        }
+
+        // Caché LRU: los vértices del triángulo pasan al frente
+        nuevaCache.assign(tri, tri + 3);
+        for (unsigned int v : cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2]) nuevaCache.push_back(v);
+        for (size_t i = TAM_CACHE_LRU; i < nuevaCache.size(); ++i) {
+            unsigned int v = nuevaCache[i];
+            puntajeVertice[v] = puntaje(-1, restantes[v]);
+        }
+        if (nuevaCache.size() > (size_t)TAM_CACHE_LRU) nuevaCache.resize(TAM_CACHE_LRU);
+        cache.swap(nuevaCache);
+        for (size_t i = 0; i < cache.size(); ++i)
+            puntajeVertice[cache[i]] = puntaje((int)i, restantes[cache[i]]);
+
+        // Puntuar los triángulos pendientes que tocan la caché y escoger el mejor
+        mejor = -1;
+        float mejorPuntaje = -1.0f;
+        for (unsigned int v : cache) {
+            const unsigned int* ady = &adyacentes[inicio[v]];
+            for (unsigned int j = 0; j < restantes[v]; ++j) {
+                unsigned int u = ady[j];
+                const unsigned int* tu = &indices[(size_t)u * 3];
+                float s = puntajeVertice[tu[0]] + puntajeVertice[tu[1]] + puntajeVertice[tu[2]];
+                if (s > mejorPuntaje) { mejorPuntaje = s; mejor = u; }
+            }
+        }
+    }
+    indices.swap(salida);
+}
+
+// Agrupa los triángulos en bloques que empiezan donde la caché se vacía y ordena los bloques
+// de afuera hacia adentro para que el depth test descarte más fragmentos. Solo se acepta el
+// nuevo orden si el ACMR no empeora más que `umbral`.
+template <typename V>
+void optimizarOverdraw(std::vector<unsigned int>& indices, const std::vector<V>& vertices, float umbral = 1.05f) {
+    size_t numTriangulos = indices.size() / 3;
+    if (numTriangulos == 0) return;
+    float acmrBase = calcularEstadisticasCache(indices, vertices.size()).acmr;
+
+    // Cortes: triángulos cuyos tres vértices fallan en la caché simulada
+    std::vector<size_t> cortes;
+    std::vector<long long> entrada(vertices.size(), -(long long)TAM_CACHE_VERTICES - 1);
+    long long fallos = 0;
+    for (size_t t = 0; t < numTriangulos; ++t) {
+        int fallosTri = 0;
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = indices[t * 3 + k];
+            if (fallos - entrada[v] > TAM_CACHE_VERTICES) { entrada[v] = fallos++; ++fallosTri; }
+        }
+        if (fallosTri == 3 || t == 0) cortes.push_back(t);
+    }
+    cortes.push_back(numTriangulos);
+
+    glm::vec3 centroMalla(0.0f);
+    for (const auto& v : vertices) centroMalla += v.position;
+    centroMalla = centroMalla / (float)vertices.size();
+
+    struct Grupo { size_t inicio, fin; float clave; };
+    std::vector<Grupo> grupos;
+    for (size_t g = 0; g + 1 < cortes.size(); ++g) {
+        glm::vec3 centro(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = cortes[g]; t < cortes[g + 1]; ++t) {
+            const glm::vec3& a = vertices[indices[t * 3]].position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& c = vertices[indices[t * 3 + 2]].position;
+            glm::vec3 n = glm::cross(b - a, c - a);   // longitud = 2 * área
+            float w = glm::length(n);
+            centro += (a + b + c) * (w / 3.0f);
+            normal += n;
+            area += w;
+        }
+        if (area > 0.0f) centro = centro / area;
+        grupos.push_back({ cortes[g], cortes[g + 1], glm::dot(centro - centroMalla, normal) });
+    }
+    std::stable_sort(grupos.begin(), grupos.end(),
+                     [](const Grupo& a, const Grupo& b) { return a.clave > b.clave; });
+
+    std::vector<unsigned int> salida;
+    salida.reserve(indices.size());
+    for (const auto& g : grupos)
+        salida.insert(salida.end(), indices.begin() + g.inicio * 3, indices.begin() + g.fin * 3);
+    if (calcularEstadisticasCache(salida, vertices.size()).acmr <= acmrBase * umbral)
+        indices.swap(salida);
+}
+
+// Renumera los vértices en el orden en que el índice los usa por primera vez.
+template <typename V>
+void optimizarOrdenVertices(std::vector<V>& vertices, std::vector<unsigned int>& indices) {
+    const unsigned int SIN_ASIGNAR = 0xFFFFFFFFu;
+    std::vector<unsigned int> remapeo(vertices.size(), SIN_ASIGNAR);
+    std::vector<V> ordenados;
+    ordenados.reserve(vertices.size());
+    for (auto& i : indices) {
+        if (remapeo[i] == SIN_ASIGNAR) {
+            remapeo[i] = (unsigned int)ordenados.size();
+            ordenados.push_back(vertices[i]);
+        }
+        i = remapeo[i];
+    }
+    vertices.swap(ordenados);
+}
+
+#endif
@@ -0,0 +1,374 @@
+// Raycasting de volumen en CPU sobre el volumen de etiquetas
+// Vista alternativa a Marching Cubes para órganos densos (músculo, esqueleto)
+
+#ifndef VOLUME_RAYCASTER_H
+#define VOLUME_RAYCASTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "label_volume.h"
+
+struct ImagenRGBA {
+    int ancho = 0, alto = 0;
+    std::vector<uint8_t> pixeles;   // RGBA8, fila 0 = abajo (mismo orden que glTexImage2D)
+};
+
+class RaycasterVolumen {
+public:
+    static const int BLOQUE = 8;           // lado de los macro-bloques para saltar espacio vacío
+    static const int TILE = 32;            // lado de los tiles de pantalla que toma cada hilo
+    static const int MAX_ETIQUETAS = 32;   // bits de la máscara de ocupación de cada bloque
+
+    RaycasterVolumen() {}
+    RaycasterVolumen(const RaycasterVolumen&) = delete;
+    RaycasterVolumen& operator=(const RaycasterVolumen&) = delete;
+    ~RaycasterVolumen() { detenerPool(); }
+
+    // Calcula la ocupación por bloques; hay que volver a llamarlo si el volumen cambia.
+    void setVolumen(const VolumenEtiquetas* v) {
+        vol = v;
+        nbx = (v->ancho + BLOQUE - 1) / BLOQUE;
+        nby = (v->alto + BLOQUE - 1) / BLOQUE;
+        nbz = (v->profundo + BLOQUE - 1) / BLOQUE;
+        ocupacion.assign((size_t)nbx * nby * nbz, 0);
+        for (int z = 0; z < v->profundo; ++z)
+            for (int y = 0; y < v->alto; ++y) {
+                const uint8_t* fila = &v->etiquetas[v->indice(0, y, z)];
+                uint32_t* filaBloques = &ocupacion[((size_t)(z / BLOQUE) * nby + y / BLOQUE) * nbx];
+                for (int x = 0; x < v->ancho; ++x)
+                    if (fila[x]) filaBloques[x / BLOQUE] |= 1u << (fila[x] & (MAX_ETIQUETAS - 1));
+            }
+    }
+
+    // Función de transferencia por órgano: color de la máscara y opacidad por unidad de longitud.
+    void setTransferencia(const glm::vec3* colores, const float* opacidades, const std::vector<bool>& activas) {
+        visibles = 0;
+        for (int e = 0; e < MAX_ETIQUETAS; ++e)
+            lut[e][0] = lut[e][1] = lut[e][2] = lut[e][3] = 0.0f;
+        for (size_t m = 0; m < activas.size() && m + 1 < MAX_ETIQUETAS; ++m) {
+            if (!activas[m] || opacidades[m] <= 0.0f) continue;
+            lut[m + 1][0] = colores[m].x;
+            lut[m + 1][1] = colores[m].y;
+            lut[m + 1][2] = colores[m].z;
+            lut[m + 1][3] = opacidades[m];
+            visibles |= 1u << (m + 1);
+        }
+    }
+
+    // Dibuja el volumen con la matriz projection * view * model (coordenadas del modelo = vóxeles).
+    // Los hilos del pool se crean en la primera llamada y se reutilizan en cada cuadro; el hilo que
+    // llama también traza tiles.
+    void render(const glm::mat4& mvp, ImagenRGBA& img, glm::vec3 fondo, int hilos = 0) {
+        img.pixeles.resize((size_t)img.ancho * img.alto * 4);
+        if (!vol || vol->vacio()) {
+            std::fill(img.pixeles.begin(), img.pixeles.end(), 0);
+            return;
+        }
+        if (hilos <= 0) hilos = std::max(1u, std::thread::hardware_concurrency());
+        if ((int)pool.size() != hilos - 1) {
+            detenerPool();
+            // Cada trabajador parte de la generación actual para no perderse la tarea que viene
+            for (int i = 1; i < hilos; ++i) pool.emplace_back(&RaycasterVolumen::bucleTrabajador, this, generacion);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mPool);
+            tarea.inv = glm::inverse(mvp);
+            tarea.img = &img;
+            tarea.fondo = fondo;
+            tarea.tilesX = (img.ancho + TILE - 1) / TILE;
+            tarea.numTiles = tarea.tilesX * ((img.alto + TILE - 1) / TILE);
+            siguiente = 0;
+            pendientes = (int)pool.size();
+            ++generacion;
+        }
+        cvTrabajo.notify_all();
+        trazarTiles();
+        // Ningún trabajador puede seguir leyendo `tarea` cuando render vuelve
+        std::unique_lock<std::mutex> lock(mPool);
+        cvFin.wait(lock, [this]() { return pendientes == 0; });
+    }
+
+    // Referencia para comprobar el salto de espacio vacío: un solo hilo y DDA vóxel a vóxel por
+    // todo el volumen, sin bloques. Composición y sombreado iguales a los de render.
+    void renderReferencia(const glm::mat4& mvp, ImagenRGBA& img, glm::vec3 fondo) const {
+        img.pixeles.resize((size_t)img.ancho * img.alto * 4);
+        if (!vol || vol->vacio()) {
+            std::fill(img.pixeles.begin(), img.pixeles.end(), 0);
+            return;
+        }
+        glm::mat4 inv = glm::inverse(mvp);
+        for (int y0 = 0; y0 < img.alto; y0 += TILE)
+            for (int x0 = 0; x0 < img.ancho; x0 += TILE)
+                trazarTile(inv, img, fondo, x0, y0, true);
+    }
+
+private:
+    const VolumenEtiquetas* vol = nullptr;
+    int nbx = 0, nby = 0, nbz = 0;
+    std::vector<uint32_t> ocupacion;   // bit e encendido si la etiqueta e aparece en el bloque
+    uint32_t visibles = 0;             // etiquetas activas con opacidad > 0
+    float lut[MAX_ETIQUETAS][4] = {};  // rgb + sigma
+
+    // Pool persistente: cada render publica una tarea nueva (generacion) y reparte los tiles con
+    // el contador atómico `siguiente`.
+    struct Tarea {
+        glm::mat4 inv;
+        ImagenRGBA* img = nullptr;
+        glm::vec3 fondo;
+        int tilesX = 0, numTiles = 0;
+    };
+    std::vector<std::thread> pool;
+    std::mutex mPool;
+    std::condition_variable cvTrabajo, cvFin;
+    Tarea tarea;
+    std::atomic<int> siguiente{ 0 };
+    int pendientes = 0;                // trabajadores que aún no terminaron la tarea actual
+    unsigned long long generacion = 0;
+    bool salir = false;
+
+    void trazarTiles() {
+        for (int t = siguiente++; t < tarea.numTiles; t = siguiente++)
+            trazarTile(tarea.inv, *tarea.img, tarea.fondo, (t % tarea.tilesX) * TILE, (t / tarea.tilesX) * TILE, false);
+    }
+
+    void bucleTrabajador(unsigned long long vista) {
+        std::unique_lock<std::mutex> lock(mPool);
+        while (true) {
+            cvTrabajo.wait(lock, [&]() { return salir || generacion != vista; });
+            if (salir) return;
+            vista = generacion;
+            lock.unlock();
+            trazarTiles();
+            lock.lock();
+            if (--pendientes == 0) cvFin.notify_one();
+        }
+    }
+
+    void detenerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mPool);
+            salir = true;
+        }
+        cvTrabajo.notify_all();
+        for (auto& h : pool) h.join();
+        pool.clear();
+        salir = false;
+    }
+
+    // Una fila de tile en SoA. La generación de rayos y la salida a RGBA8 son bucles sin ramas
+    // sobre estos arreglos que el compilador vectoriza (-O3); el DDA de cada rayo sigue siendo escalar.
+    struct FilaRayos {
+        float ox[TILE], oy[TILE], oz[TILE];
+        float dx[TILE], dy[TILE], dz[TILE];   // sin normalizar: sqrt pone una rama por errno
+        float r[TILE], g[TILE], b[TILE], a[TILE];
+    };
+
+    void trazarTile(const glm::mat4& inv, ImagenRGBA& img, glm::vec3 fondo, int x0, int y0, bool referencia) const {
+        int n = std::min(x0 + TILE, img.ancho) - x0;
+        int y1 = std::min(y0 + TILE, img.alto);
+        FilaRayos f;
+        for (int py = y0; py < y1; ++py) {
+            // inv * (nx, ny, -1/+1, 1) es afín en nx: columna 0 por nx más una base fija en la fila
+            float ny = 2.0f * (py + 0.5f) / img.alto - 1.0f;
+            float cerca[4], lejos[4], c0[4];
+            for (int k = 0; k < 4; ++k) {
+                c0[k] = inv[0][k];
+                cerca[k] = ny * inv[1][k] - inv[2][k] + inv[3][k];
+                lejos[k] = ny * inv[1][k] + inv[2][k] + inv[3][k];
+            }
+            for (int i = 0; i < n; ++i) {
+                float nx = 2.0f * (x0 + i + 0.5f) / img.ancho - 1.0f;
+                float wc = 1.0f / (nx * c0[3] + cerca[3]);
+                float wl = 1.0f / (nx * c0[3] + lejos[3]);
+                // +0.5: el vóxel (x,y,z) ocupa [x, x+1) y su centro coincide con el vértice de la malla
+                float ox = (nx * c0[0] + cerca[0]) * wc + 0.5f;
+                float oy = (nx * c0[1] + cerca[1]) * wc + 0.5f;
+                float oz = (nx * c0[2] + cerca[2]) * wc + 0.5f;
+                f.ox[i] = ox; f.oy[i] = oy; f.oz[i] = oz;
+                f.dx[i] = (nx * c0[0] + lejos[0]) * wl + 0.5f - ox;
+                f.dy[i] = (nx * c0[1] + lejos[1]) * wl + 0.5f - oy;
+                f.dz[i] = (nx * c0[2] + lejos[2]) * wl + 0.5f - oz;
+            }
+            for (int i = 0; i < n; ++i) {
+                float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                glm::vec3 o(f.ox[i], f.oy[i], f.oz[i]), d(f.dx[i], f.dy[i], f.dz[i]);
+                float largo = glm::length(d);
+                if (referencia) trazarRayoReferencia(o, d / largo, largo, acc);
+                else trazarRayo(o, d / largo, largo, acc);
+                f.r[i] = acc[0]; f.g[i] = acc[1]; f.b[i] = acc[2]; f.a[i] = acc[3];
+            }
+            uint8_t* salida = &img.pixeles[((size_t)py * img.ancho + x0) * 4];
+            for (int i = 0; i < n; ++i) {
+                float resto = 1.0f - f.a[i];
+                salida[i * 4 + 0] = aByte(f.r[i] + resto * fondo.x);
+                salida[i * 4 + 1] = aByte(f.g[i] + resto * fondo.y);
+                salida[i * 4 + 2] = aByte(f.b[i] + resto * fondo.z);
+                salida[i * 4 + 3] = aByte(f.a[i]);
+            }
+        }
+    }
+
+    // Se recorta después de escalar (mismo resultado): así el bucle de salida queda sin ramas
+    static uint8_t aByte(float v) {
+        return (uint8_t)(int)std::min(std::max(v * 255.0f + 0.5f, 0.5f), 255.5f);
+    }
+
+    // Intersección rayo-caja; devuelve false si no hay intersección.
+    static bool cruzarCaja(const float o[3], const float inv[3], const float mn[3], const float mx[3],
+                           float& tEntrada, float& tSalida, int& ejeEntrada) {
+        tEntrada = -1e30f; tSalida = 1e30f; ejeEntrada = 0;
+        for (int a = 0; a < 3; ++a) {
+            float t0 = (mn[a] - o[a]) * inv[a];
+            float t1 = (mx[a] - o[a]) * inv[a];
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > tEntrada) { tEntrada = t0; ejeEntrada = a; }
+            tSalida = std::min(tSalida, t1);
+        }
+        return tEntrada <= tSalida;
+    }
+
+    // Recorre el rayo con DDA vóxel a vóxel dentro de los bloques ocupados y salta los vacíos.
+    void trazarRayo(glm::vec3 origen, glm::vec3 dir, float tMaxRayo, float acc[4]) const {
+        const int dim[3] = { vol->ancho, vol->alto, vol->profundo };
+        float o[3] = { origen.x, origen.y, origen.z };
+        float d[3] = { dir.x, dir.y, dir.z };
+        float inv[3];
+        for (int a = 0; a < 3; ++a) {
+            if (std::fabs(d[a]) < 1e-8f) d[a] = (d[a] < 0.0f) ? -1e-8f : 1e-8f;
+            inv[a] = 1.0f / d[a];
+        }
+        const float mn[3] = { 0.0f, 0.0f, 0.0f };
+        const float mx[3] = { (float)dim[0], (float)dim[1], (float)dim[2] };
+        float t, tFin;
+        int eje;
+        if (!cruzarCaja(o, inv, mn, mx, t, tFin, eje)) return;
+        t = std::max(t, 0.0f);
+        tFin = std::min(tFin, tMaxRayo);
+        const uint32_t* uocup = ocupacion.data();
+        const uint8_t* etiquetas = vol->etiquetas.data();
+
+        while (t < tFin && acc[3] < 0.98f) {
+            float tInicio = t;
+            // Vóxel y bloque en el que se encuentra el rayo
+            int v[3];
+            for (int a = 0; a < 3; ++a)
+                v[a] = std::min(std::max((int)std::floor(o[a] + d[a] * (t + 1e-4f)), 0), dim[a] - 1);
+            int b[3] = { v[0] / BLOQUE, v[1] / BLOQUE, v[2] / BLOQUE };
+            float bmn[3], bmx[3];
+            for (int a = 0; a < 3; ++a) {
+                bmn[a] = (float)(b[a] * BLOQUE);
+                bmx[a] = (float)std::min((b[a] + 1) * BLOQUE, dim[a]);
+            }
+            float tB0, tB1;
+            int ejeB;
+            cruzarCaja(o, inv, bmn, bmx, tB0, tB1, ejeB);
+            tB1 = std::min(tB1, tFin);
+
+            // Salto de espacio vacío: ninguna etiqueta visible en este bloque
+            if (!(uocup[((size_t)b[2] * nby + b[1]) * nbx + b[0]] & visibles)) {
+                t = std::max(tB1, t + 1e-4f);
+                eje = ejeB;   // la siguiente cara atravesada es la de salida del bloque
+                for (int a = 0; a < 3; ++a) {
+                    float ts = ((d[a] > 0.0f ? bmx[a] : bmn[a]) - o[a]) * inv[a];
+                    if (ts <= tB1 + 1e-5f) { eje = a; break; }
+                }
+                continue;
+            }
+
+            // DDA dentro del bloque
+            int paso[3];
+            float tSig[3], tDelta[3];
+            for (int a = 0; a < 3; ++a) {
+                paso[a] = (d[a] > 0.0f) ? 1 : -1;
+                float borde = (float)(v[a] + (d[a] > 0.0f ? 1 : 0));
+                tSig[a] = (borde - o[a]) * inv[a];
+                tDelta[a] = std::fabs(inv[a]);
+            }
+            while (true) {
+                int a = (tSig[0] < tSig[1]) ? ((tSig[0] < tSig[2]) ? 0 : 2) : ((tSig[1] < tSig[2]) ? 1 : 2);
+                float tSalidaVoxel = std::max(std::min(tSig[a], tB1), t);
+                uint8_t e = etiquetas[((size_t)v[2] * dim[1] + v[1]) * dim[0] + v[0]] & (MAX_ETIQUETAS - 1);
+                if (visibles & (1u << e)) {
+                    const float* c = lut[e];
+                    float alfa = 1.0f - std::exp(-c[3] * (tSalidaVoxel - t));
+                    // Sombreado según la cara del vóxel por la que entró el rayo
+                    float peso = (1.0f - acc[3]) * alfa;
+                    float luz = peso * (0.35f + 0.65f * std::fabs(d[eje]));
+                    acc[0] += luz * c[0];
+                    acc[1] += luz * c[1];
+                    acc[2] += luz * c[2];
+                    acc[3] += peso;
+                    if (acc[3] >= 0.98f) break;   // terminación temprana
+                }
+                t = tSalidaVoxel;
+                if (t >= tB1) { eje = a; break; }   // el primer vóxel del bloque siguiente entra por esta cara
+                v[a] += paso[a];
+                tSig[a] += tDelta[a];
+                eje = a;
+                if (v[a] < bmn[a] || v[a] >= bmx[a]) break;
+            }
+            t = std::max(t, tInicio + 1e-4f);
+        }
+    }
+
+    // DDA sin macro-bloques de renderReferencia.
+    void trazarRayoReferencia(glm::vec3 origen, glm::vec3 dir, float tMaxRayo, float acc[4]) const {
+        const int dim[3] = { vol->ancho, vol->alto, vol->profundo };
+        float o[3] = { origen.x, origen.y, origen.z };
+        float d[3] = { dir.x, dir.y, dir.z };
+        float inv[3];
+        for (int a = 0; a < 3; ++a) {
+            if (std::fabs(d[a]) < 1e-8f) d[a] = (d[a] < 0.0f) ? -1e-8f : 1e-8f;
+            inv[a] = 1.0f / d[a];
+        }
+        const float mn[3] = { 0.0f, 0.0f, 0.0f };
+        const float mx[3] = { (float)dim[0], (float)dim[1], (float)dim[2] };
+        float t, tFin;
+        int eje;
+        if (!cruzarCaja(o, inv, mn, mx, t, tFin, eje)) return;
+        t = std::max(t, 0.0f);
+        tFin = std::min(tFin, tMaxRayo);
+        if (t >= tFin) return;
+
+        int v[3], paso[3];
+        float tSig[3], tDelta[3];
+        for (int a = 0; a < 3; ++a) {
+            v[a] = std::min(std::max((int)std::floor(o[a] + d[a] * (t + 1e-4f)), 0), dim[a] - 1);
+            paso[a] = (d[a] > 0.0f) ? 1 : -1;
+            tSig[a] = ((float)(v[a] + (d[a] > 0.0f ? 1 : 0)) - o[a]) * inv[a];
+            tDelta[a] = std::fabs(inv[a]);
+        }
+        while (true) {
+            int a = (tSig[0] < tSig[1]) ? ((tSig[0] < tSig[2]) ? 0 : 2) : ((tSig[1] < tSig[2]) ? 1 : 2);
+            float tSalidaVoxel = std::max(std::min(tSig[a], tFin), t);
+            uint8_t e = vol->at(v[0], v[1], v[2]) & (MAX_ETIQUETAS - 1);
+            if (visibles & (1u << e)) {
+                const float* c = lut[e];
+                float alfa = 1.0f - std::exp(-c[3] * (tSalidaVoxel - t));
+                float peso = (1.0f - acc[3]) * alfa;
+                float luz = peso * (0.35f + 0.65f * std::fabs(d[eje]));
+                acc[0] += luz * c[0];
+                acc[1] += luz * c[1];
+                acc[2] += luz * c[2];
+                acc[3] += peso;
+                if (acc[3] >= 0.98f) return;
+            }
+            t = tSalidaVoxel;
+            if (t >= tFin) return;
+            v[a] += paso[a];
+            tSig[a] += tDelta[a];
+            eje = a;
+            if (v[a] < 0 || v[a] >= dim[a]) return;
+        }
+    }
+};
+
+#endif